@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// Fixed-depth search over a built-in set of positions on a fresh single-threaded
+// engine with the hand-written evaluation. The node total is deterministic and
+// doubles as a signature of the search.
+uint64_t bench(int depth, std::ostream& out);
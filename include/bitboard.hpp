@@ -0,0 +1,96 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+using Bitboard = uint64_t;
+
+// Squares are numbered a1 = 0 ... h8 = 63 (rank-major)
+static const int NO_SQUARE = 64;
+
+static inline int make_square(int x, int y)
+{
+    return (y << 3) | x;
+}
+
+static inline int square_x(int sq)
+{
+    return sq & 7;
+}
+
+static inline int square_y(int sq)
+{
+    return sq >> 3;
+}
+
+static inline Bitboard square_bb(int sq)
+{
+    return Bitboard(1) << sq;
+}
+
+static inline int popcount(Bitboard b)
+{
+    return std::popcount(b);
+}
+
+static inline int lsb(Bitboard b)
+{
+    return std::countr_zero(b);
+}
+
+static inline int pop_lsb(Bitboard& b)
+{
+    int sq = lsb(b);
+    b &= b - 1;
+    return sq;
+}
+
+static const Bitboard FILE_A = 0x0101010101010101ULL;
+static const Bitboard FILE_H = FILE_A << 7;
+static const Bitboard RANK_1 = 0xFFULL;
+static const Bitboard RANK_8 = RANK_1 << 56;
+
+// Precomputed attack tables, filled once at startup (bitboard.cpp)
+extern Bitboard KNIGHT_ATTACKS[64];
+extern Bitboard KING_ATTACKS[64];
+extern Bitboard PAWN_ATTACKS[2][64]; // [color_index][square]
+
+extern Bitboard BETWEEN[64][64]; // squares strictly between two aligned squares
+extern Bitboard LINE[64][64];    // whole line through two aligned squares
+
+struct Magic
+{
+    Bitboard mask;     // relevant occupancy, board edges excluded
+    Bitboard magic;
+    Bitboard* attacks; // slice of the shared attack table
+    unsigned shift;
+};
+
+extern Magic BISHOP_MAGICS[64];
+extern Magic ROOK_MAGICS[64];
+
+// Set at startup when the CPU supports BMI2, PEXT then replaces the multiply
+extern bool use_pext;
+Bitboard pext_attacks(const Magic& m, Bitboard occupied);
+
+static inline Bitboard magic_attacks(const Magic& m, Bitboard occupied)
+{
+    if (use_pext)
+        return pext_attacks(m, occupied);
+    return m.attacks[((occupied & m.mask) * m.magic) >> m.shift];
+}
+
+static inline Bitboard bishop_attacks(int sq, Bitboard occupied)
+{
+    return magic_attacks(BISHOP_MAGICS[sq], occupied);
+}
+
+static inline Bitboard rook_attacks(int sq, Bitboard occupied)
+{
+    return magic_attacks(ROOK_MAGICS[sq], occupied);
+}
+
+static inline Bitboard queen_attacks(int sq, Bitboard occupied)
+{
+    return bishop_attacks(sq, occupied) | rook_attacks(sq, occupied);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+
+#include "chess.hpp"
+
+static const int DEFAULT_BOOK_DEPTH = 16; // plies from the start of the game
+
+// Polyglot (.bin) opening book. The file is mapped read-only and shared, so
+// every engine process on a host reads the same page-cache copy. Entries are
+// 16 bytes, big-endian and sorted by key, positions are found by binary search.
+class OpeningBook
+{
+    const uint8_t* data = nullptr;
+    size_t entry_count = 0;
+    size_t map_size = 0;
+    int max_ply = DEFAULT_BOOK_DEPTH;
+
+    std::mt19937_64 rng{std::random_device{}()};
+
+    size_t lower_bound(uint64_t key) const;
+
+public:
+    OpeningBook() = default;
+    ~OpeningBook();
+
+    OpeningBook(const OpeningBook&) = delete;
+    OpeningBook& operator=(const OpeningBook&) = delete;
+
+    bool open(const std::string& path); // false if the file cannot be mapped
+    void close();
+    bool is_open() const { return data != nullptr; }
+
+    void set_depth(int plies) { max_ply = plies; }
+
+    // Polyglot key, unrelated to ChessBoard::hash
+    static uint64_t key(const ChessBoard& board);
+
+    // Picks a book move at random, weighted by the entries' weights. False
+    // past the book depth or when the position is not in the book.
+    bool probe(ChessBoard& board, Move& move);
+};
@@ -7,7 +7,12 @@
 #include <cstdint>
 #include <vector>
 
-enum class PieceType
+#include "bitboard.hpp"
+#include "eval.hpp"
+#include "nnue.hpp"
+#include "zobrist.hpp"
+
+enum class PieceType : uint8_t
 {
     NONE,
     PAWN,
@@ -18,7 +23,7 @@ enum class PieceType
     KING
 };
 
-enum class PieceColor
+enum class PieceColor : uint8_t
 {
     NONE,
     WHITE,
@@ -31,34 +36,105 @@ struct ChessPiece
     PieceColor color;
 };
 
+// Bitboard array indices
+static inline int color_index(PieceColor c)
+{
+    return c == PieceColor::BLACK ? 1 : 0;
+}
+
+static inline int type_index(PieceType t)
+{
+    return int(t) - 1;
+}
+
+// Move flags, stored in the top 4 bits of a Move
+enum MoveFlag : uint16_t
+{
+    QUIET         = 0,
+    DOUBLE_PUSH   = 1,
+    KING_CASTLE   = 2,
+    QUEEN_CASTLE  = 3,
+    CAPTURE       = 4,
+    EP_CAPTURE    = 5,
+    PROMOTION     = 8,  // plus 0 knight, 1 bishop, 2 rook, 3 queen
+    PROMO_CAPTURE = 12
+};
+
+// 16-bit move: from square (bits 0-5), to square (6-11), flags (12-15).
+// The all-zero move a1a1 never occurs and marks "no move".
 struct Move
 {
-    ChessPiece p;
-    uint8_t to;   // (4-bit x)(4-bit y)
-    uint8_t from; // (4-bit x)(4-bit y)
+    uint16_t data = 0;
+
+    Move() = default;
+    constexpr Move(int from, int to, int flags = QUIET)
+        : data(uint16_t(from | (to << 6) | (flags << 12)))
+    {}
+
+    int from() const  { return data & 0x3F; }
+    int to() const    { return (data >> 6) & 0x3F; }
+    int flags() const { return data >> 12; }
+
+    bool is_null() const      { return data == 0; }
+    bool is_capture() const   { return flags() & CAPTURE; }
+    bool is_promotion() const { return flags() & PROMOTION; }
+    bool is_castle() const    { return flags() == KING_CASTLE || flags() == QUEEN_CASTLE; }
+
+    PieceType promotion_type() const { return PieceType(int(PieceType::KNIGHT) + (flags() & 3)); }
+
+    bool operator==(const Move& other) const = default;
 };
 
-struct HistoryMove
+static const int MAX_MOVES = 256;
+
+// Fixed-capacity move buffer filled in place by the generators
+struct MoveList
 {
-    uint8_t from, to;
-    ChessPiece p;
-    ChessPiece captured;
+    Move moves[MAX_MOVES];
+    int count = 0;
 
-    // Castling
-    uint8_t captured_rook_from = 0;
-    uint8_t captured_rook_to   = 0;
-    ChessPiece captured_rook_piece{PieceType::NONE, PieceColor::WHITE};
+    void push_back(const Move& m) { moves[count++] = m; }
+    void clear() { count = 0; }
+
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    Move& operator[](int i) { return moves[i]; }
+    Move* begin() { return moves; }
+    Move* end() { return moves + count; }
+    const Move* begin() const { return moves; }
+    const Move* end() const { return moves + count; }
+};
+
+static const int MAX_PLY      = 128;  // deepest search line
+static const int MAX_GAME_PLY = 1024; // moves a game may have before a search starts
+
+// State before a move, restored as is by undo_move
+struct HistoryMove
+{
+    Move move;            // the flags tell castling, en passant and promotion apart
+    ChessPiece moved;     // before promotion
+    ChessPiece captured;  // the en passant pawn for EP_CAPTURE
 
     // Castling rights
     bool white_ks, white_qs, black_ks, black_qs;
+    bool white_k, black_k;
 
-    // Promotion
-    bool was_promotion = false;
+    uint8_t ep_square;
+    int psq_score;
+    uint64_t hash;
+    Bitboard checkers;
 };
 
+// Long algebraic notation, e.g. "e2e4" or "e7e8q"
+std::string move_to_string(const Move& m);
+
+// Plain data throughout, so copying a board for another thread is a flat copy
 class ChessBoard
 {
-    std::vector<HistoryMove> history;
+    // Undo stack, room for a full game plus a search on top of it
+    HistoryMove history[MAX_GAME_PLY + MAX_PLY];
+    int history_count = 0;
 
     bool white_king_moved = false;
     bool black_king_moved = false;
@@ -67,31 +143,70 @@ class ChessBoard
     bool black_kingside_rook_moved = false;
     bool black_queenside_rook_moved = false;
 
-    std::vector<Move> get_pawn_moves(uint8_t x, uint8_t y, ChessPiece p);
-    std::vector<Move> get_knight_moves(uint8_t x, uint8_t y, ChessPiece p);
-    std::vector<Move> get_bishop_moves(uint8_t x, uint8_t y, ChessPiece p);
-    std::vector<Move> get_rook_moves(uint8_t x, uint8_t y, ChessPiece p);
-    std::vector<Move> get_queen_moves(uint8_t x, uint8_t y, ChessPiece p);
-    std::vector<Move> get_king_moves(uint8_t x, uint8_t y, ChessPiece p);
-    std::vector<uint8_t> king_attacks(uint8_t x, uint8_t y);
-    bool will_be_check(const Move* move);
+    void get_pawn_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves);
+    void get_knight_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves);
+    void get_bishop_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves);
+    void get_rook_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves);
+    void get_queen_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves);
+    void get_king_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves);
+    void add_castling_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves);
+
+    void put_piece(uint8_t x, uint8_t y, ChessPiece p);
+    void remove_piece(uint8_t x, uint8_t y);
+    void clear();
+    void check_hash() const;
+    void update_checkers();
+
+    void compute_accumulator(int perspective, int16_t* out) const;
+    void update_accumulator(const HistoryMove& m, bool undo);
+    void check_accumulator() const;
 
 public:
     ChessBoard();
-    ~ChessBoard();
 
+    // Throw std::length_error once MAX_GAME_PLY + MAX_PLY moves are on the undo stack
     void make_move(const Move* move);
     void undo_move();
+    void make_null_move();
+    void undo_null_move();
 
     void load_fen(const std::string& FEN);
-
-    bool is_check(PieceColor c);
+    int game_ply() const { return history_count; } // moves that can be undone
+    bool parse_move(const std::string& text, Move& move);
+
+    Bitboard attackers_to(int sq, Bitboard occ) const;
+    Bitboard pinned_pieces(PieceColor c) const;
+    bool is_square_attacked(int sq, PieceColor by) const;
+    ChessPiece piece_on(int sq) const { return board[square_x(sq)][square_y(sq)]; }
+    int see(const Move& m) const;
+    bool is_check(PieceColor c);  // cached for the side to move
     bool is_checkmate();
     bool is_valid_move(const Move* move);
-    std::vector<Move> get_moves();
+    uint64_t compute_hash() const;
+    void refresh_accumulator(); // after a network is loaded
+    int castling_rights() const; // WHITE_OO | WHITE_OOO | BLACK_OO | BLACK_OOO
+    void get_moves(MoveList& moves);
+    void get_legal_moves(MoveList& moves);
 
     void print() const;
 
+    // Mailbox view of the bitboards below, kept in sync by put/remove_piece
     ChessPiece board[8][8];
     PieceColor turn;
+
+    Bitboard pieces[2][6]; // [color_index][type_index]
+    Bitboard occupancy[2]; // [color_index]
+    Bitboard occupied;
+    uint8_t king_square[2]; // [color_index], NO_SQUARE if missing
+    uint8_t ep_square;      // NO_SQUARE unless an en passant capture is possible
+    Bitboard checkers;      // pieces giving check to the side to move
+
+    // Zobrist key, updated incrementally by make_move/undo_move
+    uint64_t hash;
+
+    // Running material + piece-square sum (centipawns, white's view), kept by put/remove_piece
+    int psq_score;
+
+    // Network first layer for both sides, kept by make_move/undo_move while NNUE_NET is set
+    NnueAccumulator accumulator;
 };
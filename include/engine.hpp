@@ -1,22 +1,140 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
 #include "chess.hpp"
+#include "syzygy.hpp"
+#include "tt.hpp"
+
+// Scores are in centipawns; mate scores count plies from the root
+static const int MATE_SCORE  = 32000;
+static const int MATE_IN_MAX = MATE_SCORE - 1000;
+static const int TB_WIN_SCORE = MATE_IN_MAX - MAX_PLY; // tablebase win, counted like a mate but below any
+static const int TB_WIN_IN_MAX = TB_WIN_SCORE - MAX_PLY;
+
+// Budget for one search, any limit left at 0 is unused
+struct SearchLimits
+{
+    int depth = 0;
+    int64_t movetime = 0; // ms to spend on this move
+    int64_t wtime = 0;    // ms left on the clocks
+    int64_t btime = 0;
+    int64_t winc = 0;     // ms increment per move
+    int64_t binc = 0;
+    int movestogo = 0;
+    uint64_t nodes = 0;
+    bool infinite = false;
+    bool ponder = false;  // search the opponent's time, limits apply from ponderhit()
+};
+
+// Progress report after each completed iteration of the main thread
+struct SearchInfo
+{
+    int depth;
+    int score;      // side to move's point of view
+    uint64_t nodes; // summed over all threads
+    uint64_t tbhits;
+    int64_t time;   // ms
+    int hashfull;   // permille
+    std::vector<Move> pv;
+};
+
+// Per-thread search state; threads share only the engine's hash table and limits
+struct SearchThread
+{
+    int id = 0;
+    ChessBoard board;
+    std::atomic<uint64_t> nodes{0};
+    std::atomic<uint64_t> tb_hits{0};
+
+    Move best_move{};
+    int best_score = 0;
+    int completed_depth = 0;
+
+    // Move ordering, learnt from beta cutoffs of quiet moves
+    Move killers[MAX_PLY][2]{};
+    int history[2][64][64]{};          // [color_index][from][to]
+    Move counter_moves[2][6][64]{};    // reply to [color_index][type_index][to] of the last move
+    Move move_stack[MAX_PLY]{};        // move made at each ply, a null Move for a null move
+
+    void new_search();
+    void clear_heuristics();
+
+    // Only the owning thread writes, so a plain load/store avoids a locked add
+    void count_node() { nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+    void count_tb_hit() { tb_hits.store(tb_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+};
 
 class ChessEngine
 {
-    Move search(const ChessBoard* position, int depth);
-    float quiescence(ChessBoard* board, float alpha, float beta, int depth);
-    float negamax(
-        ChessBoard* board,
+    TranspositionTable tt;
+    Tablebases tablebases;
+    std::vector<std::unique_ptr<SearchThread>> threads;
+
+    // Root moves left by the tablebases, empty when the root is not in them
+    MoveList root_moves;
+
+    std::atomic<bool> stopped{false};
+    uint64_t node_limit = 0;
+    std::chrono::steady_clock::time_point start_time;
+    int64_t soft_limit = 0; // ms, no new iteration is started after this
+    int64_t hard_limit = 0; // ms, the running iteration is aborted after this
+
+    // While pondering the time limits are suspended, they count from limit_start
+    std::atomic<bool> pondering{false};
+    std::atomic<int64_t> limit_start{0}; // ms into the search
+
+    std::function<void(const SearchInfo&)> info_callback;
+
+    void check_limits();
+    bool time_up(int64_t limit) const;
+
+    void iterate(SearchThread* thread, int max_depth);
+    Move aspiration(SearchThread* thread, int depth, int& score);
+    void report(SearchThread* thread);
+    Move search(SearchThread* thread, int depth, int alpha, int beta, int& best_score);
+    int quiescence(SearchThread* thread, int alpha, int beta, int depth);
+    int negamax(
+        SearchThread* thread,
         int depth,
-        float alpha,
-        float beta);
+        int ply,
+        int alpha,
+        int beta,
+        bool allow_null = true);
 
 public:
     ChessEngine();
     ~ChessEngine();
 
-    float eval(const ChessBoard* position);
+    void set_hash_size(size_t mb);
+    void set_threads(int count);
+    void clear_hash();
+    int set_syzygy_path(const std::string& paths); // returns the number of tables found
+    void set_info_callback(std::function<void(const SearchInfo&)> callback);
+
+    int eval(const ChessBoard* position); // centipawns, white's point of view
+    // The board may have at most MAX_GAME_PLY moves played, the search needs
+    // the rest of the undo stack; std::length_error otherwise
     Move make_move(const ChessBoard* board);
+    Move make_move(const ChessBoard* board, const SearchLimits& limits);
+
+    // make_move split in two for front ends that search on a worker thread:
+    // start_clock arms the limits on the caller's thread, so a stop() or
+    // ponderhit() sent right after it applies to the search think() then runs
+    void start_clock(const SearchLimits& limits, PieceColor us);
+    Move think(const ChessBoard* board, const SearchLimits& limits);
+
+    void stop();
+    void ponderhit(); // the predicted move was played, switch to the normal time limits
+    bool is_pondering() const;
+    int64_t elapsed() const; // ms since the search started
+    uint64_t node_count() const; // summed over all threads
+    uint64_t tb_hit_count() const;
+    int depth_reached() const;
+
+    void get_pv(const ChessBoard* position, int max_length, std::vector<Move>& pv);
 };
@@ -0,0 +1,22 @@
+#pragma once
+
+static constexpr int PAWN_VALUE   = 100;
+static constexpr int KNIGHT_VALUE = 293;
+static constexpr int BISHOP_VALUE = 300;
+static constexpr int ROOK_VALUE   = 456;
+static constexpr int QUEEN_VALUE  = 905;
+static constexpr int KING_VALUE   = 0; // both kings are always on the board
+
+// [type_index]
+static constexpr int PIECE_VALUE[6] = {
+    PAWN_VALUE, KNIGHT_VALUE, BISHOP_VALUE, ROOK_VALUE, QUEEN_VALUE, KING_VALUE
+};
+
+// Material plus piece-square value of every piece on every square, in
+// centipawns from white's point of view (black entries are negated)
+struct PieceSquareTable
+{
+    int value[2][6][64]; // [color_index][type_index][square]
+};
+
+extern const PieceSquareTable PSQT;
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "chess.hpp"
+
+// Legal move generation shared by ChessBoard (make/unmake) and Position
+// (copy-make). A board type provides pieces, occupancy, occupied,
+// king_square, ep_square and attackers_to(sq, occ); the side to move,
+// castling rights and checkers are passed in because the two keep them
+// differently.
+
+static inline void add_moves(MoveList& moves, int from, Bitboard targets, Bitboard occupied)
+{
+    while (targets)
+    {
+        int to = pop_lsb(targets);
+        moves.push_back(Move(from, to, (occupied & square_bb(to)) ? CAPTURE : QUIET));
+    }
+}
+
+// Pawn targets exclude en passant, which is generated on its own
+static inline void add_pawn_moves(MoveList& moves, int from, Bitboard targets, Bitboard occupied)
+{
+    while (targets)
+    {
+        int to = pop_lsb(targets);
+        int flags = (occupied & square_bb(to)) ? CAPTURE : QUIET;
+
+        if (square_y(to) == 0 || square_y(to) == 7)
+        {
+            // Queen first, the underpromotions rarely matter
+            for (int promo = 3; promo >= 0; promo --)
+                moves.push_back(Move(from, to, flags | PROMOTION | promo));
+        }
+        else if (to - from == 16 || from - to == 16)
+            moves.push_back(Move(from, to, DOUBLE_PUSH));
+        else
+            moves.push_back(Move(from, to, flags));
+    }
+}
+
+// Pushes and captures of a pawn of color `us`, en passant excluded
+static inline Bitboard pawn_targets(int sq, int us, Bitboard occupied, Bitboard enemies)
+{
+    int forward = (us == 0) ? 8 : -8;
+    int start_y = (us == 0) ? 1 : 6;
+
+    // A pawn on the last rank only occurs on hand-made boards
+    if (square_y(sq) == (us == 0 ? 7 : 0))
+        return 0;
+
+    Bitboard targets = PAWN_ATTACKS[us][sq] & enemies;
+    if (!(occupied & square_bb(sq + forward)))
+    {
+        targets |= square_bb(sq + forward);
+        if (square_y(sq) == start_y && !(occupied & square_bb(sq + 2 * forward)))
+            targets |= square_bb(sq + 2 * forward);
+    }
+    return targets;
+}
+
+// Pieces of color `us` that are the only blocker between their king and an enemy slider
+template <typename Board>
+Bitboard find_pinned(const Board& b, int us)
+{
+    int king_sq = b.king_square[us];
+    const Bitboard* enemy = b.pieces[us ^ 1];
+    Bitboard queens = enemy[type_index(PieceType::QUEEN)];
+
+    // Enemy sliders that would hit the king on an empty board
+    Bitboard snipers =
+        (rook_attacks(king_sq, 0) & (enemy[type_index(PieceType::ROOK)] | queens)) |
+        (bishop_attacks(king_sq, 0) & (enemy[type_index(PieceType::BISHOP)] | queens));
+
+    Bitboard pinned = 0;
+    while (snipers)
+    {
+        Bitboard blockers = BETWEEN[king_sq][pop_lsb(snipers)] & b.occupied;
+        if (blockers && !(blockers & (blockers - 1)))
+            pinned |= blockers & b.occupancy[us];
+    }
+    return pinned;
+}
+
+// Legal moves of `us`, whose king must be on the board. Pieces are visited in
+// square order, which is the order the search sees equal moves in.
+template <typename Board>
+void generate_legal_moves(const Board& b, int us, int castling, Bitboard checkers, MoveList& moves)
+{
+    moves.clear();
+
+    int king_sq = b.king_square[us];
+    Bitboard own  = b.occupancy[us];
+    Bitboard them = b.occupancy[us ^ 1];
+    Bitboard occupied = b.occupied;
+
+    // The king may not step onto an attacked square, nor along the ray of a slider
+    // it is currently shielding, hence the attack test without the king on the board
+    Bitboard without_king = occupied ^ square_bb(king_sq);
+    Bitboard king_targets = KING_ATTACKS[king_sq] & ~own;
+    Bitboard safe = 0;
+    while (king_targets)
+    {
+        int to = pop_lsb(king_targets);
+        if (!(b.attackers_to(to, without_king) & them))
+            safe |= square_bb(to);
+    }
+
+    // Double check: only the king can move
+    if (checkers & (checkers - 1))
+    {
+        add_moves(moves, king_sq, safe, occupied);
+        return;
+    }
+
+    // In single check the other pieces have to capture the checker or block it
+    Bitboard check_mask = checkers
+        ? checkers | BETWEEN[king_sq][lsb(checkers)]
+        : ~Bitboard(0);
+
+    Bitboard pinned = find_pinned(b, us);
+    const Bitboard* ours = b.pieces[us];
+    Bitboard pawns   = ours[type_index(PieceType::PAWN)];
+    Bitboard knights = ours[type_index(PieceType::KNIGHT)];
+    Bitboard bishops = ours[type_index(PieceType::BISHOP)];
+    Bitboard rooks   = ours[type_index(PieceType::ROOK)];
+
+    Bitboard pieces = own;
+    while (pieces)
+    {
+        int sq = pop_lsb(pieces);
+        Bitboard from = square_bb(sq);
+
+        Bitboard targets;
+        if (pawns & from)        targets = pawn_targets(sq, us, occupied, them);
+        else if (knights & from) targets = KNIGHT_ATTACKS[sq];
+        else if (bishops & from) targets = bishop_attacks(sq, occupied);
+        else if (rooks & from)   targets = rook_attacks(sq, occupied);
+        else if (sq != king_sq)  targets = queen_attacks(sq, occupied);
+        else
+        {
+            add_moves(moves, sq, safe, occupied);
+
+            // Castling: the king's path must be empty and unattacked
+            int rank = (us == 0) ? 0 : 56;
+            if (checkers || sq != rank + 4)
+                continue;
+
+            int oo  = (us == 0) ? WHITE_OO : BLACK_OO;
+            int ooo = (us == 0) ? WHITE_OOO : BLACK_OOO;
+
+            if ((castling & oo) &&
+                !(occupied & (square_bb(rank + 5) | square_bb(rank + 6))) &&
+                !(b.attackers_to(rank + 5, occupied) & them) &&
+                !(b.attackers_to(rank + 6, occupied) & them))
+                moves.push_back(Move(sq, rank + 6, KING_CASTLE));
+
+            if ((castling & ooo) &&
+                !(occupied & (square_bb(rank + 1) | square_bb(rank + 2) | square_bb(rank + 3))) &&
+                !(b.attackers_to(rank + 3, occupied) & them) &&
+                !(b.attackers_to(rank + 2, occupied) & them))
+                moves.push_back(Move(sq, rank + 2, QUEEN_CASTLE));
+            continue;
+        }
+
+        targets &= ~own & check_mask;
+
+        // A pinned piece may only move along the line through its king
+        if (pinned & from)
+            targets &= LINE[king_sq][sq];
+
+        if (pawns & from)
+            add_pawn_moves(moves, sq, targets, occupied);
+        else
+            add_moves(moves, sq, targets, occupied);
+    }
+
+    // En passant removes two pieces from the board at once, so it is checked
+    // directly against the resulting occupancy instead of the pin and check masks
+    if (b.ep_square != NO_SQUARE)
+    {
+        Bitboard captured = square_bb(b.ep_square + (us == 0 ? -8 : 8));
+        Bitboard capturers = PAWN_ATTACKS[us ^ 1][b.ep_square] & pawns;
+        while (capturers)
+        {
+            int from = pop_lsb(capturers);
+            Bitboard occ = (occupied ^ square_bb(from) ^ captured) | square_bb(b.ep_square);
+
+            if (!(b.attackers_to(king_sq, occ) & them & ~captured))
+                moves.push_back(Move(from, b.ep_square, EP_CAPTURE));
+        }
+    }
+}
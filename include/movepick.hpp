@@ -0,0 +1,58 @@
+#pragma once
+
+#include "chess.hpp"
+
+static const int HISTORY_MAX = 16384; // history scores stay within +-HISTORY_MAX
+
+// Hands out the legal moves of a node one at a time, in stages: the hash move,
+// captures that do not lose material (by SEE), killers and the counter move,
+// quiet moves by history, and finally the losing captures. Each stage is only
+// scored once the previous one is exhausted, so a cutoff early on skips the rest.
+class MovePicker
+{
+    enum class Stage
+    {
+        TT_MOVE,
+        INIT_CAPTURES,
+        GOOD_CAPTURES,
+        KILLERS,
+        INIT_QUIETS,
+        QUIETS,
+        BAD_CAPTURES,
+        DONE
+    };
+
+    const ChessBoard* board;
+    MoveList& moves;
+    int scores[MAX_MOVES];
+
+    Stage stage = Stage::TT_MOVE;
+    bool captures_only = false;
+    Move tt_move;
+    Move refutations[3]; // killers, then the counter move
+    int refutation_index = 0;
+    const int (*history)[64];
+
+    int current = 0;   // next unpicked move of the running stage
+    int end_noisy = 0; // captures and promotions sit in front of end_noisy
+    int bad_begin = 0; // losing captures left over by the good capture stage
+
+    bool is_noisy(const Move& m) const;
+    bool is_refutation(const Move& m) const;
+    int pick_best(int begin, int end);
+
+public:
+    // history is the side to move's [from][to] table
+    MovePicker(const ChessBoard* board,
+               MoveList& moves,
+               const Move& tt_move,
+               const Move killers[2],
+               const Move& counter,
+               const int (*history)[64]);
+
+    // Quiescence: only the captures and promotions that SEE does not lose
+    MovePicker(const ChessBoard* board, MoveList& moves);
+
+    // nullptr once every move has been returned
+    const Move* next();
+};
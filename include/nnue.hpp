@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Efficiently updatable network: (HalfKA -> NNUE_HIDDEN) x 2 -> 1.
+//
+// Each side sees the board from its own king: a feature is a piece (own or
+// enemy, and its type) on a square, for a given square of the own king.
+// Boards with the king on files e-h are mirrored onto files a-d, leaving
+// 32 king squares. The two accumulators (side to move first) go through a
+// clipped ReLU into a single output neuron.
+static const int NNUE_KING_BUCKETS = 32;
+static const int NNUE_INPUTS = NNUE_KING_BUCKETS * 2 * 6 * 64;
+static const int NNUE_HIDDEN = 256;
+
+// Quantisation: accumulators are clipped to [0, NNUE_QA], output weights
+// carry NNUE_QB, and the output is scaled to centipawns by NNUE_SCALE
+static const int NNUE_QA    = 255;
+static const int NNUE_QB    = 64;
+static const int NNUE_SCALE = 400;
+
+// Weights file, all little-endian:
+//   char     magic[4]      "C2NN"
+//   uint32   version       NNUE_VERSION
+//   uint32   hidden        NNUE_HIDDEN
+//   int16    feature_weights[NNUE_INPUTS][NNUE_HIDDEN]
+//   int16    feature_bias[NNUE_HIDDEN]
+//   int16    output_weights[2][NNUE_HIDDEN]  side to move, then the other side
+//   int32    output_bias
+static const uint32_t NNUE_VERSION = 1;
+
+static const char* const NNUE_DEFAULT_FILE = "chess2.nnue"; // loaded at startup when present
+
+struct NnueNetwork
+{
+    alignas(64) int16_t feature_weights[NNUE_INPUTS][NNUE_HIDDEN];
+    alignas(64) int16_t feature_bias[NNUE_HIDDEN];
+    alignas(64) int16_t output_weights[2][NNUE_HIDDEN];
+    int32_t output_bias;
+};
+
+// [color_index of the perspective][neuron]
+struct alignas(64) NnueAccumulator
+{
+    int16_t values[2][NNUE_HIDDEN];
+};
+
+extern const NnueNetwork* NNUE_NET; // null until a network is loaded
+
+// Replaces the loaded network; on failure the previous one is kept. Not
+// safe while a search runs, boards refresh their accumulators afterwards.
+bool nnue_load(const std::string& path);
+void nnue_unload();
+
+// Input index of a piece (color_index, type_index) on sq, seen by `perspective`
+// with its king on king_sq
+static inline int nnue_feature(int perspective, int king_sq, int color, int type, int sq)
+{
+    int orient = perspective ? 56 : 0;                   // rank flip for black
+    int mirror = ((king_sq ^ orient) & 7) >= 4 ? 7 : 0;  // file flip for a king on e-h
+    int king   = king_sq ^ orient ^ mirror;
+    int bucket = (king >> 3) * 4 + (king & 7);
+    int piece  = (color == perspective ? 0 : 6) + type;
+    return (bucket * 12 + piece) * 64 + (sq ^ orient ^ mirror);
+}
+
+// acc = feature bias + the rows of `features`
+void nnue_refresh(int16_t* acc, const int* features, int count);
+
+// acc += added rows - removed rows, in one pass over the accumulator
+void nnue_update(int16_t* acc, const int* added, int add_count, const int* removed, int remove_count);
+
+// Centipawns from the point of view of `side` (color_index)
+int nnue_evaluate(const NnueAccumulator& acc, int side);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+#include "chess.hpp"
+#include "position.hpp"
+
+// Counts leaf nodes of the legal move tree, the last ply is bulk counted
+uint64_t perft(ChessBoard& board, int depth);
+uint64_t perft(const Position& position, int depth); // copy-make
+
+// Prints the subtree size below every root move, root moves are split over
+// `threads` workers. Returns the total.
+uint64_t perft_divide(const ChessBoard& board, int depth, int threads, std::ostream& out);
+
+// Runs the reference positions against their known counts, returns true if all match
+bool perft_suite(int threads, std::ostream& out);
+
+// Times make/unmake on ChessBoard against copy-make on Position over the
+// reference positions, `extra_depth` plies deeper than the suite. Returns
+// true if both agree with the known counts.
+bool perft_compare(int extra_depth, std::ostream& out);
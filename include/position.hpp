@@ -0,0 +1,35 @@
+#pragma once
+
+#include "chess.hpp"
+
+// Compact board state for copy-make: a move is played on a copy of the
+// position, so going back is just using the previous copy and nothing has
+// to be undone. It holds only bitboards and a few bytes of state, the
+// mailbox and undo stack of ChessBoard are left out.
+struct Position
+{
+    Bitboard pieces[2][6]; // [color_index][type_index]
+    Bitboard occupancy[2]; // [color_index]
+    Bitboard occupied;
+    uint64_t hash;         // same key ChessBoard computes
+    int psq_score;         // material + piece-square sum, white's view
+
+    uint8_t side;           // color_index of the side to move
+    uint8_t castling;       // WHITE_OO | WHITE_OOO | BLACK_OO | BLACK_OOO
+    uint8_t ep_square;      // NO_SQUARE unless an en passant capture is possible
+    uint8_t king_square[2]; // [color_index]
+
+    Position() = default;
+    explicit Position(const ChessBoard& board); // throws if a king is missing
+
+    void make_move(const Move& m);
+    void get_legal_moves(MoveList& moves) const;
+
+    Bitboard attackers_to(int sq, Bitboard occ) const;
+    bool in_check() const;
+
+private:
+    int type_on(int color, int sq) const; // type_index, -1 if empty
+    void put_piece(int color, int type, int sq);
+    void remove_piece(int color, int type, int sq);
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "position.hpp"
+
+// Tablebase result for the side to move. Cursed wins and blessed losses are
+// wins and losses that the fifty move rule turns into draws.
+enum WdlScore
+{
+    WDL_LOSS         = -2,
+    WDL_BLESSED_LOSS = -1,
+    WDL_DRAW         =  0,
+    WDL_CURSED_WIN   =  1,
+    WDL_WIN          =  2
+};
+
+// Syzygy endgame tables read from local .rtbw (win/draw/loss) and .rtbz
+// (distance to zeroing move) files. The directories are only scanned for
+// file names, a table is mapped read-only the first time it is probed.
+// Probing is thread safe, init() must not run during a search.
+class Tablebases
+{
+public:
+    // Defined in syzygy.cpp
+    struct PairsData;
+    struct TableFile;
+    struct Table;
+
+private:
+    enum ProbeState
+    {
+        PROBE_FAIL,       // a table is missing or unreadable
+        PROBE_OK,
+        PROBE_CHANGE_STM, // the DTZ table only stores the other side to move
+        PROBE_ZEROING     // the best move is a capture or pawn move
+    };
+
+    std::vector<std::unique_ptr<Table>> tables;
+    std::unordered_map<uint64_t, Table*> by_material; // both colourings of every table
+    int max_pieces = 0;
+    std::mutex map_lock;
+
+    Table* find(const Position& pos) const;
+    bool map(TableFile& file, const Table& table, bool dtz);
+
+    int probe_table(const Position& pos, bool dtz, int wdl, ProbeState& state);
+    int search_captures(const Position& pos, bool pawn_moves, ProbeState& state);
+    int search_dtz(const Position& pos, ProbeState& state);
+
+public:
+    Tablebases();
+    ~Tablebases();
+
+    Tablebases(const Tablebases&) = delete;
+    Tablebases& operator=(const Tablebases&) = delete;
+
+    // Directories separated by ':', an empty path or "<empty>" unloads all tables
+    void init(const std::string& paths);
+    void clear();
+
+    int cardinality() const { return max_pieces; } // most pieces of any table, 0 without tables
+    size_t size() const { return tables.size(); }
+
+    // False if the position is not covered. Castling rights are not checked,
+    // the tables assume there are none.
+    bool probe_wdl(const Position& pos, int& wdl);
+    bool probe_dtz(const Position& pos, int& dtz); // plies, negative when losing
+
+    // Keeps only the root moves that preserve the best result and, among
+    // those, make the quickest progress towards the next zeroing move
+    bool filter_root_moves(const Position& pos, MoveList& moves);
+};
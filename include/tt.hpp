@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "chess.hpp"
+
+enum class Bound : uint8_t
+{
+    NONE,
+    UPPER, // score <= stored score (fail low)
+    LOWER, // score >= stored score (fail high)
+    EXACT
+};
+
+struct TTEntry
+{
+    int score;
+    int depth;
+    Bound bound;
+    Move move; // best move, null if none
+};
+
+// Shared hash table of search results. Every slot is two 64-bit words written
+// without locks; the key word is stored XORed with the data word, so a slot
+// torn by two threads writing at once fails verification and reads as a miss.
+class TranspositionTable
+{
+    struct Slot
+    {
+        std::atomic<uint64_t> key; // position key ^ data
+        std::atomic<uint64_t> data;
+    };
+
+    static const int CLUSTER_SIZE = 4;
+
+    // One cache line per probe
+    struct alignas(64) Cluster
+    {
+        Slot slots[CLUSTER_SIZE];
+    };
+
+    Cluster* table = nullptr;
+    size_t cluster_count = 0;
+    uint8_t generation = 0; // 6-bit search age
+
+    Cluster& cluster(uint64_t key) const;
+
+public:
+    explicit TranspositionTable(size_t mb = 16);
+    ~TranspositionTable();
+
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    void resize(size_t mb);
+    void clear();
+    void new_search();
+
+    bool probe(uint64_t key, TTEntry& entry) const;
+    void store(uint64_t key, int depth, Bound bound, int score, const Move* best);
+
+    int hashfull() const; // permille of slots used by the current search
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+struct ZobristKeys
+{
+    uint64_t pieces[2][6][64]; // [color_index][type_index][square]
+    uint64_t side;             // black to move
+    uint64_t castling[16];     // by castling rights mask
+    uint64_t ep_file[8];
+};
+
+// Castling rights mask bits
+static const int WHITE_OO  = 1;
+static const int WHITE_OOO = 2;
+static const int BLACK_OO  = 4;
+static const int BLACK_OOO = 8;
+
+static constexpr uint64_t splitmix64(uint64_t& state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static constexpr ZobristKeys make_zobrist_keys()
+{
+    ZobristKeys keys{};
+    uint64_t state = 0x43686573733221ULL;
+
+    for (int c = 0; c < 2; c ++)
+        for (int t = 0; t < 6; t ++)
+            for (int sq = 0; sq < 64; sq ++)
+                keys.pieces[c][t][sq] = splitmix64(state);
+
+    keys.side = splitmix64(state);
+
+    // Combined rights hash as the XOR of their single-right keys
+    uint64_t rights[4];
+    for (int i = 0; i < 4; i ++)
+        rights[i] = splitmix64(state);
+    for (int mask = 0; mask < 16; mask ++)
+        for (int i = 0; i < 4; i ++)
+            if (mask & (1 << i))
+                keys.castling[mask] ^= rights[i];
+
+    for (int f = 0; f < 8; f ++)
+        keys.ep_file[f] = splitmix64(state);
+
+    return keys;
+}
+
+// Generated at compile time from a fixed seed, so keys are identical across builds
+inline constexpr ZobristKeys ZOBRIST = make_zobrist_keys();
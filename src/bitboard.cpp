@@ -0,0 +1,220 @@
+#include "bitboard.hpp"
+
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_PEXT 1
+#endif
+
+Bitboard KNIGHT_ATTACKS[64];
+Bitboard KING_ATTACKS[64];
+Bitboard PAWN_ATTACKS[2][64];
+
+Bitboard BETWEEN[64][64];
+Bitboard LINE[64][64];
+
+Magic BISHOP_MAGICS[64];
+Magic ROOK_MAGICS[64];
+
+bool use_pext = false;
+
+// Sum over all squares of 2^popcount(mask)
+static Bitboard ROOK_TABLE[0x19000];
+static Bitboard BISHOP_TABLE[0x1480];
+
+static const int ROOK_DIRS[4][2]   = { { 1,  0}, {-1,  0}, { 0,  1}, { 0, -1} };
+static const int BISHOP_DIRS[4][2] = { { 1,  1}, {-1,  1}, { 1, -1}, {-1, -1} };
+
+static inline bool in_bounds(int x, int y)
+{
+    return (unsigned)x < 8 && (unsigned)y < 8;
+}
+
+static Bitboard step_attacks(int sq, const int (*offsets)[2], int count)
+{
+    Bitboard attacks = 0;
+    for (int i = 0; i < count; i ++)
+    {
+        int x = square_x(sq) + offsets[i][0];
+        int y = square_y(sq) + offsets[i][1];
+        if (in_bounds(x, y))
+            attacks |= square_bb(make_square(x, y));
+    }
+    return attacks;
+}
+
+// Slow ray walk, only used to fill the tables
+static Bitboard sliding_attacks(int sq, Bitboard occupied, const int (*dirs)[2])
+{
+    Bitboard attacks = 0;
+    for (int d = 0; d < 4; d ++)
+    {
+        int x = square_x(sq) + dirs[d][0];
+        int y = square_y(sq) + dirs[d][1];
+        while (in_bounds(x, y))
+        {
+            Bitboard b = square_bb(make_square(x, y));
+            attacks |= b;
+            if (occupied & b)
+                break;
+            x += dirs[d][0];
+            y += dirs[d][1];
+        }
+    }
+    return attacks;
+}
+
+#ifdef HAVE_PEXT
+__attribute__((target("bmi2")))
+Bitboard pext_attacks(const Magic& m, Bitboard occupied)
+{
+    return m.attacks[_pext_u64(occupied, m.mask)];
+}
+
+__attribute__((target("bmi2")))
+static unsigned pext_index(Bitboard occupied, Bitboard mask)
+{
+    return _pext_u64(occupied, mask);
+}
+#else
+Bitboard pext_attacks(const Magic& m, Bitboard occupied)
+{
+    return magic_attacks(m, occupied);
+}
+#endif
+
+static uint64_t rand64(uint64_t& state)
+{
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+static void init_magics(Magic* magics, Bitboard* table, const int (*dirs)[2])
+{
+    static Bitboard occupancies[4096];
+    static Bitboard references[4096];
+    static int epoch[4096];
+    static int attempt = 0;
+
+    // Per-rank seeds that find magics quickly with this generator
+    static const uint64_t SEEDS[8] = { 728, 10316, 55013, 32803, 12281, 15100, 16645, 255 };
+
+    Bitboard* next = table;
+
+    for (int sq = 0; sq < 64; sq ++)
+    {
+        Magic& m = magics[sq];
+
+        Bitboard edges = ((RANK_1 | RANK_8) & ~(RANK_1 << (8 * square_y(sq)))) |
+                         ((FILE_A | FILE_H) & ~(FILE_A << square_x(sq)));
+
+        m.mask    = sliding_attacks(sq, 0, dirs) & ~edges;
+        m.shift   = 64 - popcount(m.mask);
+        m.attacks = next;
+
+        // Enumerate all subsets of the mask (Carry-Rippler)
+        int size = 0;
+        Bitboard b = 0;
+        do
+        {
+            occupancies[size] = b;
+            references[size]  = sliding_attacks(sq, b, dirs);
+#ifdef HAVE_PEXT
+            if (use_pext)
+                m.attacks[pext_index(b, m.mask)] = references[size];
+#endif
+            size ++;
+            b = (b - m.mask) & m.mask;
+        } while (b);
+
+        next += size;
+
+        if (use_pext)
+            continue;
+
+        uint64_t seed = SEEDS[square_y(sq)];
+
+        // Search for a magic that maps every subset without a destructive collision
+        for (int i = 0; i < size; )
+        {
+            do
+                m.magic = rand64(seed) & rand64(seed) & rand64(seed);
+            while (popcount((m.mask * m.magic) >> 56) < 6);
+
+            attempt ++;
+            for (i = 0; i < size; i ++)
+            {
+                unsigned idx = ((occupancies[i] & m.mask) * m.magic) >> m.shift;
+
+                if (epoch[idx] < attempt)
+                {
+                    epoch[idx] = attempt;
+                    m.attacks[idx] = references[i];
+                }
+                else if (m.attacks[idx] != references[i])
+                    break;
+            }
+        }
+    }
+}
+
+static void init_bitboards()
+{
+    static const int KNIGHT_OFFSETS[8][2] = {
+        { 2,  1}, { 1,  2}, {-1,  2}, {-2,  1},
+        {-2, -1}, {-1, -2}, { 1, -2}, { 2, -1}
+    };
+    static const int KING_OFFSETS[8][2] = {
+        { 1,  0}, {-1,  0}, { 0,  1}, { 0, -1},
+        { 1,  1}, {-1,  1}, { 1, -1}, {-1, -1}
+    };
+    static const int WHITE_PAWN_OFFSETS[2][2] = { {-1,  1}, { 1,  1} };
+    static const int BLACK_PAWN_OFFSETS[2][2] = { {-1, -1}, { 1, -1} };
+
+    for (int sq = 0; sq < 64; sq ++)
+    {
+        KNIGHT_ATTACKS[sq]  = step_attacks(sq, KNIGHT_OFFSETS, 8);
+        KING_ATTACKS[sq]    = step_attacks(sq, KING_OFFSETS, 8);
+        PAWN_ATTACKS[0][sq] = step_attacks(sq, WHITE_PAWN_OFFSETS, 2);
+        PAWN_ATTACKS[1][sq] = step_attacks(sq, BLACK_PAWN_OFFSETS, 2);
+    }
+
+#ifdef HAVE_PEXT
+    __builtin_cpu_init();
+    use_pext = __builtin_cpu_supports("bmi2");
+#endif
+
+    init_magics(BISHOP_MAGICS, BISHOP_TABLE, BISHOP_DIRS);
+    init_magics(ROOK_MAGICS, ROOK_TABLE, ROOK_DIRS);
+
+    for (int a = 0; a < 64; a ++)
+    {
+        for (int b = 0; b < 64; b ++)
+        {
+            BETWEEN[a][b] = 0;
+            LINE[a][b]    = 0;
+            if (a == b)
+                continue;
+
+            for (const int (*dirs)[2] : {ROOK_DIRS, BISHOP_DIRS})
+            {
+                if (!(sliding_attacks(a, 0, dirs) & square_bb(b)))
+                    continue;
+
+                BETWEEN[a][b] = sliding_attacks(a, square_bb(b), dirs) &
+                                sliding_attacks(b, square_bb(a), dirs);
+                LINE[a][b]    = (sliding_attacks(a, 0, dirs) & sliding_attacks(b, 0, dirs)) |
+                                square_bb(a) | square_bb(b);
+            }
+        }
+    }
+}
+
+static struct BitboardInit
+{
+    BitboardInit() { init_bitboards(); }
+} bitboard_init;
@@ -1,9 +1,10 @@
 #include "chess.hpp"
+#include "movegen.hpp"
 
-static inline uint8_t compact_coords(uint8_t x, uint8_t y)
-{
-    return (x << 4) | y;
-}
+#include <cstring>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<ChessBoard>, "boards are copied as plain memory");
 
 static inline bool in_bounds(int x, int y)
 {
@@ -11,6 +12,12 @@ static inline bool in_bounds(int x, int y)
 }
 
 ChessBoard::ChessBoard()
+{
+    clear();
+    turn = PieceColor::WHITE;
+}
+
+void ChessBoard::clear()
 {
     for (int x = 0; x < 8; x ++)
     {
@@ -19,26 +26,223 @@ ChessBoard::ChessBoard()
             board[x][y] = {PieceType::NONE, PieceColor::WHITE};
         }
     }
+
+    for (int c = 0; c < 2; c ++)
+    {
+        for (int t = 0; t < 6; t ++)
+            pieces[c][t] = 0;
+        occupancy[c] = 0;
+        king_square[c] = NO_SQUARE;
+    }
+    occupied = 0;
+    ep_square = NO_SQUARE;
+    checkers = 0;
+    hash = 0;
+    psq_score = 0;
 }
 
-ChessBoard::~ChessBoard()
-{}
+int ChessBoard::castling_rights() const
+{
+    int rights = 0;
+    if (!white_king_moved && !white_kingside_rook_moved)  rights |= WHITE_OO;
+    if (!white_king_moved && !white_queenside_rook_moved) rights |= WHITE_OOO;
+    if (!black_king_moved && !black_kingside_rook_moved)  rights |= BLACK_OO;
+    if (!black_king_moved && !black_queenside_rook_moved) rights |= BLACK_OOO;
+    return rights;
+}
+
+uint64_t ChessBoard::compute_hash() const
+{
+    uint64_t key = 0;
+
+    for (int c = 0; c < 2; c ++)
+    {
+        for (int t = 0; t < 6; t ++)
+        {
+            Bitboard b = pieces[c][t];
+            while (b)
+                key ^= ZOBRIST.pieces[c][t][pop_lsb(b)];
+        }
+    }
+
+    if (turn == PieceColor::BLACK)
+        key ^= ZOBRIST.side;
+
+    key ^= ZOBRIST.castling[castling_rights()];
+
+    if (ep_square != NO_SQUARE)
+        key ^= ZOBRIST.ep_file[square_x(ep_square)];
+
+    return key;
+}
+
+void ChessBoard::check_hash() const
+{
+#ifdef DEBUG
+    if (hash != compute_hash())
+        throw std::logic_error("Zobrist key out of sync with the board");
+#endif
+}
+
+void ChessBoard::compute_accumulator(int perspective, int16_t* out) const
+{
+    int features[32];
+    int count = 0;
+
+    // Without its king a side has no frame to see the board from, only the bias is left
+    int king_sq = king_square[perspective];
+    for (int c = 0; c < 2 && king_sq != NO_SQUARE; c ++)
+    {
+        for (int t = 0; t < 6; t ++)
+        {
+            Bitboard b = pieces[c][t];
+            while (b && count < 32)
+                features[count++] = nnue_feature(perspective, king_sq, c, t, pop_lsb(b));
+        }
+    }
+
+    nnue_refresh(out, features, count);
+}
+
+void ChessBoard::refresh_accumulator()
+{
+    if (!NNUE_NET)
+        return;
+
+    for (int p = 0; p < 2; p ++)
+        compute_accumulator(p, accumulator.values[p]);
+}
+
+// Applies the pieces a move takes off and puts on the board, undo swaps the two
+void ChessBoard::update_accumulator(const HistoryMove& m, bool undo)
+{
+    struct Change
+    {
+        int color, type, sq;
+    };
+
+    int us    = color_index(m.moved.color);
+    int from  = m.move.from();
+    int to    = m.move.to();
+    int flags = m.move.flags();
+    int moved = type_index(m.moved.type);
+
+    Change off[3] = {{us, moved, from}};
+    Change on[2]  = {{us, m.move.is_promotion() ? type_index(m.move.promotion_type()) : moved, to}};
+    int off_count = 1, on_count = 1;
+
+    if (m.captured.type != PieceType::NONE)
+    {
+        int sq = (flags == EP_CAPTURE) ? make_square(square_x(to), square_y(from)) : to;
+        off[off_count++] = {us ^ 1, type_index(m.captured.type), sq};
+    }
+
+    if (m.move.is_castle())
+    {
+        int rank = square_y(from);
+        int rook = type_index(PieceType::ROOK);
+        off[off_count++] = {us, rook, make_square(flags == KING_CASTLE ? 7 : 0, rank)};
+        on[on_count++]   = {us, rook, make_square(flags == KING_CASTLE ? 5 : 3, rank)};
+    }
+
+    const Change* added   = undo ? off : on;
+    const Change* removed = undo ? on : off;
+    int add_count    = undo ? off_count : on_count;
+    int remove_count = undo ? on_count : off_count;
+
+    for (int p = 0; p < 2; p ++)
+    {
+        if (king_square[p] == NO_SQUARE)
+            continue;
+
+        // The king's own view changes entirely when it moves
+        if (p == us && m.moved.type == PieceType::KING)
+        {
+            compute_accumulator(p, accumulator.values[p]);
+            continue;
+        }
+
+        int add[3], remove[3];
+        for (int i = 0; i < add_count; i ++)
+            add[i] = nnue_feature(p, king_square[p], added[i].color, added[i].type, added[i].sq);
+        for (int i = 0; i < remove_count; i ++)
+            remove[i] = nnue_feature(p, king_square[p], removed[i].color, removed[i].type, removed[i].sq);
+
+        nnue_update(accumulator.values[p], add, add_count, remove, remove_count);
+    }
+}
+
+void ChessBoard::check_accumulator() const
+{
+#ifdef DEBUG
+    if (!NNUE_NET)
+        return;
+
+    NnueAccumulator fresh;
+    for (int p = 0; p < 2; p ++)
+    {
+        if (king_square[p] == NO_SQUARE)
+            continue;
+
+        compute_accumulator(p, fresh.values[p]);
+        if (std::memcmp(fresh.values[p], accumulator.values[p], sizeof(fresh.values[p])) != 0)
+            throw std::logic_error("NNUE accumulator out of sync with the board");
+    }
+#endif
+}
+
+void ChessBoard::put_piece(uint8_t x, uint8_t y, ChessPiece p)
+{
+    if (p.type == PieceType::NONE)
+        return;
+
+    Bitboard b = square_bb(make_square(x, y));
+    board[x][y] = p;
+    if (p.type == PieceType::KING)
+        king_square[color_index(p.color)] = make_square(x, y);
+    hash ^= ZOBRIST.pieces[color_index(p.color)][type_index(p.type)][make_square(x, y)];
+    psq_score += PSQT.value[color_index(p.color)][type_index(p.type)][make_square(x, y)];
+    pieces[color_index(p.color)][type_index(p.type)] |= b;
+    occupancy[color_index(p.color)] |= b;
+    occupied |= b;
+}
+
+void ChessBoard::remove_piece(uint8_t x, uint8_t y)
+{
+    ChessPiece& p = board[x][y];
+    if (p.type == PieceType::NONE)
+        return;
+
+    Bitboard b = ~square_bb(make_square(x, y));
+    hash ^= ZOBRIST.pieces[color_index(p.color)][type_index(p.type)][make_square(x, y)];
+    psq_score -= PSQT.value[color_index(p.color)][type_index(p.type)][make_square(x, y)];
+    pieces[color_index(p.color)][type_index(p.type)] &= b;
+    occupancy[color_index(p.color)] &= b;
+    occupied &= b;
+    p = {PieceType::NONE, PieceColor::WHITE};
+}
 
 void ChessBoard::make_move(const Move* move)
 {
-    uint8_t to_x   = move->to >> 4;
-    uint8_t to_y   = move->to & 0x0F;
-    uint8_t from_x = move->from >> 4;
-    uint8_t from_y = move->from & 0x0F;
+    int from  = move->from();
+    int to    = move->to();
+    int flags = move->flags();
+
+    uint8_t to_x   = square_x(to);
+    uint8_t to_y   = square_y(to);
+    uint8_t from_x = square_x(from);
+    uint8_t from_y = square_y(from);
+
+    ChessPiece p = board[from_x][from_y];
 
-    // Optional: bounds check
-    if (!in_bounds(from_x, from_y) || !in_bounds(to_x, to_y))
-        throw std::out_of_range("Move coordinates out of bounds");
+    // Checked in every build, a full stack would be written past its end
+    if (history_count == MAX_GAME_PLY + MAX_PLY)
+        throw std::length_error("Undo stack full");
 
-    HistoryMove m;
-    m.from = move->from;
-    m.to   = move->to;
-    m.p    = move->p;
+    // Saved straight into the stack slot
+    HistoryMove& m = history[history_count++];
+    m.move     = *move;
+    m.moved    = p;
     m.captured = board[to_x][to_y];
 
     // SAVE CASTLING STATE
@@ -46,112 +250,173 @@ void ChessBoard::make_move(const Move* move)
     m.white_qs = white_queenside_rook_moved;
     m.black_ks = black_kingside_rook_moved;
     m.black_qs = black_queenside_rook_moved;
-    m.captured_rook_piece.type = PieceType::NONE;
-
-    // Move the piece
-    board[from_x][from_y].type = PieceType::NONE;
-    board[to_x][to_y] = move->p;
+    m.white_k  = white_king_moved;
+    m.black_k  = black_king_moved;
+    m.ep_square = ep_square;
+    m.psq_score = psq_score;
+    m.hash = hash;
+    m.checkers = checkers;
+
+    // Rights and en passant are re-hashed once they are final
+    hash ^= ZOBRIST.castling[castling_rights()];
+    if (ep_square != NO_SQUARE)
+        hash ^= ZOBRIST.ep_file[square_x(ep_square)];
+
+    // A king move, or anything leaving or landing on a corner, drops castling rights
+    if (p.type == PieceType::KING)
+    {
+        if (p.color == PieceColor::WHITE) white_king_moved = true;
+        else black_king_moved = true;
+    }
 
-    // Castling
-    if (move->p.type == PieceType::KING)
+    for (int sq : {from, to})
     {
-        if (from_x == 4 && to_x == 6)
-        { // Kingside
-            uint8_t rook_from_x = 7;
-            uint8_t rook_to_x   = 5;
-            uint8_t y = from_y;
-
-            // Save rook in history
-            m.captured_rook_from = rook_from_x;
-            m.captured_rook_to   = rook_to_x;
-            m.captured_rook_piece = board[rook_from_x][y];
-
-            // Move rook
-            board[rook_to_x][y] = board[rook_from_x][y];
-            board[rook_from_x][y].type = PieceType::NONE;
-
-            if (move->p.color == PieceColor::WHITE) white_kingside_rook_moved = true;
-            else black_kingside_rook_moved = true;
-        }
-        else if (from_x == 4 && to_x == 2)
-        { // Queenside
-            uint8_t rook_from_x = 0;
-            uint8_t rook_to_x   = 3;
-            uint8_t y = from_y;
+        if (sq == make_square(0, 0)) white_queenside_rook_moved = true;
+        if (sq == make_square(7, 0)) white_kingside_rook_moved  = true;
+        if (sq == make_square(0, 7)) black_queenside_rook_moved = true;
+        if (sq == make_square(7, 7)) black_kingside_rook_moved  = true;
+    }
 
-            m.captured_rook_from = rook_from_x;
-            m.captured_rook_to   = rook_to_x;
-            m.captured_rook_piece = board[rook_from_x][y];
+    // En passant: the captured pawn sits beside the destination square
+    if (flags == EP_CAPTURE)
+    {
+        m.captured = board[to_x][from_y];
+        remove_piece(to_x, from_y);
+    }
 
-            board[rook_to_x][y] = board[rook_from_x][y];
-            board[rook_from_x][y].type = PieceType::NONE;
+    // Move the piece, a promotion lands as the new piece
+    remove_piece(to_x, to_y);
+    remove_piece(from_x, from_y);
+    put_piece(to_x, to_y, move->is_promotion() ? ChessPiece{move->promotion_type(), p.color} : p);
 
-            if (move->p.color == PieceColor::WHITE) white_queenside_rook_moved = true;
-            else black_queenside_rook_moved = true;
-        }
+    // A double push allows en passant when an enemy pawn can take
+    ep_square = NO_SQUARE;
+    if (flags == DOUBLE_PUSH)
+    {
+        int passed = make_square(to_x, (from_y + to_y) / 2);
+        int us = color_index(p.color);
+        if (PAWN_ATTACKS[us][passed] & pieces[us ^ 1][type_index(PieceType::PAWN)])
+            ep_square = passed;
     }
-    else if (move->p.type == PieceType::PAWN)
+
+    // Castling moves the rook as well, the king move already dropped the rights
+    if (move->is_castle())
     {
-        if ((move->p.color == PieceColor::WHITE && to_y == 7) ||
-            (move->p.color == PieceColor::BLACK && to_y == 0))
-        {
-            m.was_promotion = true;
+        uint8_t rook_from_x = (flags == KING_CASTLE) ? 7 : 0;
+        uint8_t rook_to_x   = (flags == KING_CASTLE) ? 5 : 3;
 
-            board[to_x][to_y].type  = PieceType::QUEEN;
-            board[to_x][to_y].color = move->p.color;
-        }
+        ChessPiece rook = board[rook_from_x][from_y];
+        remove_piece(rook_from_x, from_y);
+        put_piece(rook_to_x, from_y, rook);
     }
 
-    history.push_back(m);
+    hash ^= ZOBRIST.castling[castling_rights()];
+    if (ep_square != NO_SQUARE)
+        hash ^= ZOBRIST.ep_file[square_x(ep_square)];
+
+    if (NNUE_NET)
+        update_accumulator(m, false);
 
     // Switch turn
     turn = (turn == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+    hash ^= ZOBRIST.side;
+    update_checkers();
+
+    check_hash();
+    check_accumulator();
 }
 
 void ChessBoard::undo_move()
 {
-    HistoryMove m = history.back();
-    history.pop_back();
-
-    uint8_t to_x   = m.to >> 4;
-    uint8_t to_y   = m.to & 0x0F;
-    uint8_t from_x = m.from >> 4;
-    uint8_t from_y = m.from & 0x0F;
+    const HistoryMove& m = history[--history_count];
 
-    if (m.was_promotion)
-    {
-        // Remove promoted piece
-        board[to_x][to_y].type = PieceType::NONE;
-    }
-
-    // Undo move
-    board[from_x][from_y] = m.p;
-    board[to_x][to_y] = m.captured;
+    int flags = m.move.flags();
+    uint8_t to_x   = square_x(m.move.to());
+    uint8_t to_y   = square_y(m.move.to());
+    uint8_t from_x = square_x(m.move.from());
+    uint8_t from_y = square_y(m.move.from());
 
     // Undo rook move if castling
-    if (m.captured_rook_piece.type != PieceType::NONE)
+    if (m.move.is_castle())
     {
-        uint8_t y = m.from & 0x0F;
-        board[m.captured_rook_from][y] = m.captured_rook_piece;
-        board[m.captured_rook_to][y].type = PieceType::NONE;
+        uint8_t rook_from_x = (flags == KING_CASTLE) ? 7 : 0;
+        uint8_t rook_to_x   = (flags == KING_CASTLE) ? 5 : 3;
+
+        ChessPiece rook = board[rook_to_x][from_y];
+        remove_piece(rook_to_x, from_y);
+        put_piece(rook_from_x, from_y, rook);
     }
 
+    // Undo move (also removes a promoted piece)
+    remove_piece(to_x, to_y);
+    put_piece(from_x, from_y, m.moved);
+    if (flags == EP_CAPTURE)
+        put_piece(to_x, from_y, m.captured);
+    else
+        put_piece(to_x, to_y, m.captured);
+
     white_kingside_rook_moved  = m.white_ks;
     white_queenside_rook_moved = m.white_qs;
     black_kingside_rook_moved  = m.black_ks;
     black_queenside_rook_moved = m.black_qs;
+    white_king_moved = m.white_k;
+    black_king_moved = m.black_k;
+    ep_square = m.ep_square;
+    psq_score = m.psq_score;
+    checkers = m.checkers;
+
+    turn = (turn == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+    hash = m.hash;
+
+    if (NNUE_NET)
+        update_accumulator(m, true);
+
+    check_hash();
+    check_accumulator();
+}
+
+void ChessBoard::make_null_move()
+{
+    // Checked in every build, a full stack would be written past its end
+    if (history_count == MAX_GAME_PLY + MAX_PLY)
+        throw std::length_error("Undo stack full");
+
+    // Only the side to move and en passant change
+    HistoryMove& m = history[history_count++];
+    m.ep_square = ep_square;
+    m.hash      = hash;
+    m.checkers  = checkers;
+
+    if (ep_square != NO_SQUARE)
+        hash ^= ZOBRIST.ep_file[square_x(ep_square)];
+    ep_square = NO_SQUARE;
 
+    // Never made in check, and the side that passed cannot be giving one
+    checkers = 0;
+
+    turn = (turn == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+    hash ^= ZOBRIST.side;
+
+    check_hash();
+}
+
+void ChessBoard::undo_null_move()
+{
+    const HistoryMove& m = history[--history_count];
+
+    ep_square = m.ep_square;
+    checkers = m.checkers;
     turn = (turn == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+    hash = m.hash;
+
+    check_hash();
 }
 
 void ChessBoard::load_fen(const std::string& fen)
 {
     // Clear board
-    for (int x = 0; x < 8; ++x)
-        for (int y = 0; y < 8; ++y)
-            board[x][y] = {PieceType::NONE, PieceColor::WHITE};
-
-    history.clear();
+    clear();
+    history_count = 0;
 
     std::istringstream ss(fen);
     std::string board_part;
@@ -197,7 +462,7 @@ void ChessBoard::load_fen(const std::string& fen)
         if (x >= 8 || y < 0)
             throw std::runtime_error("Invalid FEN: board overflow");
 
-        board[x][y] = p;
+        put_piece(x, y, p);
         x++;
     }
 
@@ -205,335 +470,191 @@ void ChessBoard::load_fen(const std::string& fen)
     ss >> turn;
     this->turn = (turn == "w") ? PieceColor::WHITE : PieceColor::BLACK;
 
+    // Castling rights (all available when the field is missing)
+    std::string castling = "KQkq";
+    ss >> castling;
+    white_kingside_rook_moved  = castling.find('K') == std::string::npos;
+    white_queenside_rook_moved = castling.find('Q') == std::string::npos;
+    black_kingside_rook_moved  = castling.find('k') == std::string::npos;
+    black_queenside_rook_moved = castling.find('q') == std::string::npos;
+    white_king_moved = white_kingside_rook_moved && white_queenside_rook_moved;
+    black_king_moved = black_kingside_rook_moved && black_queenside_rook_moved;
+
+    // En passant target, kept only when a pawn can actually capture
+    std::string ep = "-";
+    ss >> ep;
+    if (ep.size() == 2 && ep[0] >= 'a' && ep[0] <= 'h' && (ep[1] == '3' || ep[1] == '6'))
+    {
+        int sq = make_square(ep[0] - 'a', ep[1] - '1');
+        int us = color_index(this->turn);
+        if (PAWN_ATTACKS[us ^ 1][sq] & pieces[us][type_index(PieceType::PAWN)])
+            ep_square = sq;
+    }
+
     if (y != 0 || x != 8)
         throw std::runtime_error("Invalid FEN: incomplete board");
+
+    hash = compute_hash();
+    update_checkers();
+    refresh_accumulator();
 }
 
-std::vector<Move> ChessBoard::get_moves()
+void ChessBoard::get_moves(MoveList& moves)
 {
-    std::vector<Move> moves;
+    moves.clear();
 
-    for (uint8_t i = 0; i < 64; i ++)
+    Bitboard own = occupancy[color_index(turn)];
+    while (own)
     {
-        uint8_t x = i % 8;
-        uint8_t y = i / 8;
+        int sq = pop_lsb(own);
+        uint8_t x = square_x(sq);
+        uint8_t y = square_y(sq);
         const ChessPiece p = this->board[x][y];
 
-        if (p.type == PieceType::NONE || p.color != turn)
-            continue;
-        
-        std::vector<Move> m;
         switch (p.type)
         {
             // All moves for pawns
             case PieceType::PAWN:
             {
-                m = get_pawn_moves(x, y, p);
+                get_pawn_moves(x, y, p, moves);
                 break;
             }
             
             // All moves for knights
             case PieceType::KNIGHT:
             {
-                m = get_knight_moves(x, y, p);
+                get_knight_moves(x, y, p, moves);
                 break;
             }
 
             case PieceType::BISHOP:
             {
-                m = get_bishop_moves(x, y, p);
+                get_bishop_moves(x, y, p, moves);
                 break;
             }
 
             case PieceType::ROOK:
             {
-                m = get_rook_moves(x, y, p);
+                get_rook_moves(x, y, p, moves);
                 break;
             }
 
             case PieceType::QUEEN:
             {
-                m = get_queen_moves(x, y, p);
+                get_queen_moves(x, y, p, moves);
                 break;
             }
 
             case PieceType::KING:
             {
-                m = get_king_moves(x, y, p);
+                get_king_moves(x, y, p, moves);
                 break;
             }
 
             default:
                 break;
         }
-
-        moves.insert(moves.end(), m.begin(), m.end());
     }
-
-    return moves;
 }
 
-std::vector<Move> ChessBoard::get_pawn_moves(uint8_t x, uint8_t y, ChessPiece p)
+void ChessBoard::get_legal_moves(MoveList& moves)
 {
-    std::vector<Move> moves;
-    if (p.color == PieceColor::WHITE)
-    {
-        if (in_bounds(x, y + 1) && board[x][y + 1].type == PieceType::NONE)
-        {
-            moves.push_back({p, compact_coords(x, y + 1), compact_coords(x, y)});
-
-            if (y == 1 &&
-                board[x][y + 1].type == PieceType::NONE &&
-                board[x][y + 2].type == PieceType::NONE)
-            {
-                moves.push_back({p, compact_coords(x, y + 2), compact_coords(x, y)});
-            }
-
-        }
-
-        for (int dx : {-1, 1})
-        {
-            int nx = x + dx;
-            int ny = y + 1;
-
-            if (in_bounds(nx, ny) &&
-                board[nx][ny].type != PieceType::NONE &&
-                board[nx][ny].color == PieceColor::BLACK)
-            {
-                moves.push_back({p,
-                    compact_coords(nx, ny),
-                    compact_coords(x, y)});
-            }
-        }
-    }
-    else if (p.color == PieceColor::BLACK)
+    int us = color_index(turn);
+    if (king_square[us] == NO_SQUARE)
     {
-        if (in_bounds(x, y - 1) && board[x][y - 1].type == PieceType::NONE)
-        {
-            moves.push_back({p, compact_coords(x, y - 1), compact_coords(x, y)});
-
-            if (y == 6 &&
-                board[x][y - 1].type == PieceType::NONE &&
-                board[x][y - 2].type == PieceType::NONE)
-            {
-                moves.push_back({p, compact_coords(x, y - 2), compact_coords(x, y)});
-            }
-
-        }
-
-        for (int dx : {-1, 1})
-        {
-            int nx = x + dx;
-            int ny = y - 1;
-
-            if (in_bounds(nx, ny) &&
-                board[nx][ny].type != PieceType::NONE &&
-                board[nx][ny].color == PieceColor::WHITE)
-            {
-                moves.push_back({p,
-                    compact_coords(nx, ny),
-                    compact_coords(x, y)});
-            }
-        }
+        // Without a king every pseudo-legal move is legal
+        get_moves(moves);
+        return;
     }
 
-    return moves;
+    generate_legal_moves(*this, us, castling_rights(), checkers, moves);
 }
 
-std::vector<Move> ChessBoard::get_knight_moves(uint8_t x, uint8_t y, ChessPiece p)
+Bitboard ChessBoard::pinned_pieces(PieceColor c) const
 {
-    std::vector<Move> moves;
-    moves.reserve(8);
-    static constexpr int8_t offsets[8][2] = {
-        { 2,  1}, { 1,  2},
-        {-1,  2}, {-2,  1},
-        {-2, -1}, {-1, -2},
-        { 1, -2}, { 2, -1}
-    };
-
-    for (const auto& o : offsets)
-    {
-        int nx = x + o[0];
-        int ny = y + o[1];
-
-        if (!in_bounds(nx, ny))
-            continue;
-
-        ChessPiece target = board[nx][ny];
-
-        if (target.type == PieceType::NONE ||
-            target.color != p.color)
-        {
-            moves.push_back({p,
-                compact_coords(nx, ny),
-                compact_coords(x, y)});
-        }
-    }
-
-    return moves;
+    if (king_square[color_index(c)] == NO_SQUARE)
+        return 0;
+    return find_pinned(*this, color_index(c));
 }
 
-std::vector<Move> ChessBoard::get_bishop_moves(uint8_t x, uint8_t y, ChessPiece p)
+void ChessBoard::get_pawn_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves)
 {
-    std::vector<Move> moves;
-    static constexpr int8_t dirs[4][2] = {
-        { 1,  1}, {-1,  1},
-        { 1, -1}, {-1, -1}
-    };
-
-    for (auto& d : dirs)
-    {
-        int cx = x + d[0];
-        int cy = y + d[1];
-
-        while (in_bounds(cx, cy))
-        {
-            if (board[cx][cy].type == PieceType::NONE)
-            {
-                moves.push_back({p,
-                    compact_coords(cx, cy),
-                    compact_coords(x, y)});
-            }
-            else
-            {
-                if (board[cx][cy].color != p.color)
-                {
-                    moves.push_back({p,
-                        compact_coords(cx, cy),
-                        compact_coords(x, y)});
-                }
-                break;
-            }
-            cx += d[0];
-            cy += d[1];
-        }
-    }
+    int sq = make_square(x, y);
+    int us = color_index(p.color);
+    add_pawn_moves(moves, sq, pawn_targets(sq, us, occupied, occupancy[us ^ 1]), occupied);
 
-    return moves;
+    if (ep_square != NO_SQUARE && (PAWN_ATTACKS[color_index(p.color)][sq] & square_bb(ep_square)))
+        moves.push_back(Move(sq, ep_square, EP_CAPTURE));
 }
 
-std::vector<Move> ChessBoard::get_rook_moves(uint8_t x, uint8_t y, ChessPiece p)
+void ChessBoard::get_knight_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves)
 {
-    std::vector<Move> moves;
-    static constexpr int8_t dirs[4][2] = {
-        { 1,  0}, {-1,  0},
-        { 0,  1}, { 0, -1}
-    };
-
-    for (auto& d : dirs)
-    {
-        int cx = x + d[0];
-        int cy = y + d[1];
-
-        while (in_bounds(cx, cy))
-        {
-            if (board[cx][cy].type == PieceType::NONE)
-            {
-                moves.push_back({p,
-                    compact_coords(cx, cy),
-                    compact_coords(x, y)});
-            }
-            else
-            {
-                if (board[cx][cy].color != p.color)
-                {
-                    moves.push_back({p,
-                        compact_coords(cx, cy),
-                        compact_coords(x, y)});
-                }
-                break;
-            }
-            cx += d[0];
-            cy += d[1];
-        }
-    }
-
-    return moves;
+    Bitboard targets = KNIGHT_ATTACKS[make_square(x, y)] & ~occupancy[color_index(p.color)];
+    add_moves(moves, make_square(x, y), targets, occupied);
 }
 
-std::vector<Move> ChessBoard::get_queen_moves(uint8_t x, uint8_t y, ChessPiece p)
+void ChessBoard::get_bishop_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves)
 {
-    std::vector<Move> moves;
-    static constexpr int8_t dirs[8][2] = {
-        { 1,  0}, {-1,  0}, { 0,  1}, { 0, -1},
-        { 1,  1}, {-1,  1}, { 1, -1}, {-1, -1}
-    };
-
-    for (auto& d : dirs)
-    {
-        int cx = x + d[0];
-        int cy = y + d[1];
-
-        while (in_bounds(cx, cy))
-        {
-            if (board[cx][cy].type == PieceType::NONE)
-            {
-                moves.push_back({p,
-                    compact_coords(cx, cy),
-                    compact_coords(x, y)});
-            }
-            else
-            {
-                if (board[cx][cy].color != p.color)
-                {
-                    moves.push_back({p,
-                        compact_coords(cx, cy),
-                        compact_coords(x, y)});
-                }
-                break;
-            }
-            cx += d[0];
-            cy += d[1];
-        }
-    }
+    Bitboard targets = bishop_attacks(make_square(x, y), occupied) & ~occupancy[color_index(p.color)];
+    add_moves(moves, make_square(x, y), targets, occupied);
+}
 
-    return moves;
+void ChessBoard::get_rook_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves)
+{
+    Bitboard targets = rook_attacks(make_square(x, y), occupied) & ~occupancy[color_index(p.color)];
+    add_moves(moves, make_square(x, y), targets, occupied);
 }
 
-std::vector<Move> ChessBoard::get_king_moves(uint8_t x, uint8_t y, ChessPiece p)
+void ChessBoard::get_queen_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves)
 {
-    std::vector<Move> moves;
+    Bitboard targets = queen_attacks(make_square(x, y), occupied) & ~occupancy[color_index(p.color)];
+    add_moves(moves, make_square(x, y), targets, occupied);
+}
 
+void ChessBoard::get_king_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves)
+{
     // 1. Generate normal 1-square moves
-    for (int dx = -1; dx <= 1; dx++)
-    {
-        for (int dy = -1; dy <= 1; dy++)
-        {
-            if (dx == 0 && dy == 0)
-                continue;
+    Bitboard targets = KING_ATTACKS[make_square(x, y)] & ~occupancy[color_index(p.color)];
+    add_moves(moves, make_square(x, y), targets, occupied);
 
-            int nx = x + dx;
-            int ny = y + dy;
+    // 2. Generate castling moves
+    add_castling_moves(x, y, p, moves);
+}
+
+void ChessBoard::add_castling_moves(uint8_t x, uint8_t y, ChessPiece p, MoveList& moves)
+{
+    // The king may not castle out of, through or into check
+    PieceColor enemy =
+        (p.color == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
 
-            if (!in_bounds(nx, ny))
-                continue;
+    uint8_t home_y = (p.color == PieceColor::WHITE) ? 0 : 7;
+    if (x != 4 || y != home_y)
+        return;
 
-            ChessPiece target = board[nx][ny];
-            if (target.type == PieceType::NONE || target.color != p.color)
-            {
-                moves.push_back({p, compact_coords(nx, ny), compact_coords(x, y)});
-            }
-        }
-    }
+    if (is_square_attacked(make_square(x, y), enemy))
+        return;
 
-    // 2. Generate castling moves (pseudo-legal, ignore check for now)
     if (p.color == PieceColor::WHITE && !white_king_moved)
     {
         // Kingside
         if (!white_kingside_rook_moved &&
             board[5][0].type == PieceType::NONE &&
-            board[6][0].type == PieceType::NONE)
+            board[6][0].type == PieceType::NONE &&
+            !is_square_attacked(make_square(5, 0), enemy) &&
+            !is_square_attacked(make_square(6, 0), enemy))
         {
-            moves.push_back({p, compact_coords(6,0), compact_coords(x,y)});
+            moves.push_back(Move(make_square(x, y), make_square(6, 0), KING_CASTLE));
         }
 
         // Queenside
         if (!white_queenside_rook_moved &&
             board[1][0].type == PieceType::NONE &&
             board[2][0].type == PieceType::NONE &&
-            board[3][0].type == PieceType::NONE)
+            board[3][0].type == PieceType::NONE &&
+            !is_square_attacked(make_square(3, 0), enemy) &&
+            !is_square_attacked(make_square(2, 0), enemy))
         {
-            moves.push_back({p, compact_coords(2,0), compact_coords(x,y)});
+            moves.push_back(Move(make_square(x, y), make_square(2, 0), QUEEN_CASTLE));
         }
     }
     else if (p.color == PieceColor::BLACK && !black_king_moved)
@@ -541,282 +662,230 @@ std::vector<Move> ChessBoard::get_king_moves(uint8_t x, uint8_t y, ChessPiece p)
         // Kingside
         if (!black_kingside_rook_moved &&
             board[5][7].type == PieceType::NONE &&
-            board[6][7].type == PieceType::NONE)
+            board[6][7].type == PieceType::NONE &&
+            !is_square_attacked(make_square(5, 7), enemy) &&
+            !is_square_attacked(make_square(6, 7), enemy))
         {
-            moves.push_back({p, compact_coords(6,7), compact_coords(x,y)});
+            moves.push_back(Move(make_square(x, y), make_square(6, 7), KING_CASTLE));
         }
 
         // Queenside
         if (!black_queenside_rook_moved &&
             board[1][7].type == PieceType::NONE &&
             board[2][7].type == PieceType::NONE &&
-            board[3][7].type == PieceType::NONE)
+            board[3][7].type == PieceType::NONE &&
+            !is_square_attacked(make_square(3, 7), enemy) &&
+            !is_square_attacked(make_square(2, 7), enemy))
         {
-            moves.push_back({p, compact_coords(2,7), compact_coords(x,y)});
+            moves.push_back(Move(make_square(x, y), make_square(2, 7), QUEEN_CASTLE));
         }
     }
-
-    return moves;
 }
 
-std::vector<uint8_t> ChessBoard::king_attacks(uint8_t x, uint8_t y)
+bool ChessBoard::is_valid_move(const Move* move)
 {
-    std::vector<uint8_t> attacks;
+    // Ensure the "from" square actually has the piece
+    const ChessPiece p = piece_on(move->from());
 
-    for (int dx = -1; dx <= 1; dx++)
-    {
-        for (int dy = -1; dy <= 1; dy++)
-        {
-            if (dx == 0 && dy == 0)
-                continue;
+    if (p.type == PieceType::NONE)
+        return false;
 
-            int nx = x + dx;
-            int ny = y + dy;
+    if (p.color != turn)
+        return false;
 
-            if (in_bounds(nx, ny))
-                attacks.push_back(compact_coords(nx, ny));
-        }
+    MoveList legal;
+    get_legal_moves(legal);
+
+    for (auto& m : legal)
+    {
+        if (m == *move)
+            return true;
     }
-    return attacks;
+    return false;
 }
 
-bool ChessBoard::will_be_check(const Move* move)
+Bitboard ChessBoard::attackers_to(int sq, Bitboard occ) const
 {
-    uint8_t to_x   = move->to >> 4;
-    uint8_t to_y   = move->to & 0x0F;
-    uint8_t from_x = move->from >> 4;
-    uint8_t from_y = move->from & 0x0F;
+    const Bitboard (&p)[2][6] = pieces;
+
+    Bitboard bishops = p[0][type_index(PieceType::BISHOP)] | p[1][type_index(PieceType::BISHOP)];
+    Bitboard rooks   = p[0][type_index(PieceType::ROOK)]   | p[1][type_index(PieceType::ROOK)];
+    Bitboard queens  = p[0][type_index(PieceType::QUEEN)]  | p[1][type_index(PieceType::QUEEN)];
+    Bitboard knights = p[0][type_index(PieceType::KNIGHT)] | p[1][type_index(PieceType::KNIGHT)];
+    Bitboard kings   = p[0][type_index(PieceType::KING)]   | p[1][type_index(PieceType::KING)];
+
+    return (PAWN_ATTACKS[1][sq] & p[0][type_index(PieceType::PAWN)]) |
+           (PAWN_ATTACKS[0][sq] & p[1][type_index(PieceType::PAWN)]) |
+           (KNIGHT_ATTACKS[sq] & knights) |
+           (KING_ATTACKS[sq] & kings) |
+           (bishop_attacks(sq, occ) & (bishops | queens)) |
+           (rook_attacks(sq, occ) & (rooks | queens));
+}
 
-    // Save board state
-    ChessPiece captured = board[to_x][to_y];
-    ChessPiece moved    = board[from_x][from_y];
+// Static exchange evaluation: material won by the side making m if both sides
+// keep recapturing on the target square with their least valuable attacker,
+// and either may stop when continuing would lose. Pins are ignored.
+int ChessBoard::see(const Move& m) const
+{
+    // The king only ever captures last, anything after it is illegal
+    static const int SEE_VALUE[6] = {
+        PAWN_VALUE, KNIGHT_VALUE, BISHOP_VALUE, ROOK_VALUE, QUEEN_VALUE, 20000
+    };
 
-    // Make move
-    board[to_x][to_y] = moved;
-    board[from_x][from_y] = { PieceType::NONE, PieceColor::WHITE };
+    int from = m.from();
+    int to   = m.to();
+    ChessPiece mover = piece_on(from);
 
-    // Locate king
-    int kx = -1, ky = -1;
-    if (moved.type == PieceType::KING)
-    {
-        kx = to_x;
-        ky = to_y;
-    }
-    else
-    {
-        for (int i = 0; i < 64; ++i)
-        {
-            int x = i % 8;
-            int y = i / 8;
-            if (board[x][y].type == PieceType::KING &&
-                board[x][y].color == moved.color)
-            {
-                kx = x;
-                ky = y;
-                break;
-            }
-        }
-    }
+    int gain[32];
+    int d = 0;
 
-    bool in_check = false;
-    PieceColor enemy =
-        (moved.color == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+    PieceType target = piece_on(to).type;
+    gain[0] = (target != PieceType::NONE) ? SEE_VALUE[type_index(target)] : 0;
+    if (m.flags() == EP_CAPTURE)
+        gain[0] = PAWN_VALUE;
 
-    // Scan enemy attacks
-    for (int i = 0; i < 64 && !in_check; ++i)
+    int on_square = SEE_VALUE[type_index(mover.type)];
+    if (m.is_promotion())
     {
-        int x = i % 8;
-        int y = i / 8;
-        ChessPiece p = board[x][y];
+        int promoted = PIECE_VALUE[type_index(m.promotion_type())];
+        gain[0] += promoted - PAWN_VALUE;
+        on_square = promoted;
+    }
 
-        if (p.type == PieceType::NONE || p.color != enemy)
-            continue;
+    const Bitboard (&p)[2][6] = pieces;
+    Bitboard diagonal   = p[0][type_index(PieceType::BISHOP)] | p[1][type_index(PieceType::BISHOP)] |
+                          p[0][type_index(PieceType::QUEEN)]  | p[1][type_index(PieceType::QUEEN)];
+    Bitboard orthogonal = p[0][type_index(PieceType::ROOK)]   | p[1][type_index(PieceType::ROOK)] |
+                          p[0][type_index(PieceType::QUEEN)]  | p[1][type_index(PieceType::QUEEN)];
 
-        switch (p.type)
-        {
-            case PieceType::PAWN:
-            {
-                int dir = (p.color == PieceColor::WHITE) ? 1 : -1;
-                for (int dx : {-1, 1})
-                {
-                    int nx = x + dx;
-                    int ny = y + dir;
-                    if (in_bounds(nx, ny) &&
-                        compact_coords(nx, ny) == compact_coords(kx, ky))
-                    {
-                        in_check = true;
-                    }
-                }
-                break;
-            }
+    Bitboard occ = occupied ^ square_bb(from);
+    if (m.flags() == EP_CAPTURE)
+        occ ^= square_bb(make_square(square_x(to), square_y(from)));
 
-            case PieceType::KING:
-            {
-                for (auto sq : king_attacks(x, y))
-                {
-                    if (sq == compact_coords(kx, ky))
-                        in_check = true;
-                }
-                break;
-            }
+    Bitboard attackers = attackers_to(to, occ) & occ;
+    int side = color_index(mover.color) ^ 1;
 
-            default:
-            {
-                std::vector<Move> moves;
-                switch (p.type)
-                {
-                    case PieceType::KNIGHT: moves = get_knight_moves(x, y, p); break;
-                    case PieceType::BISHOP: moves = get_bishop_moves(x, y, p); break;
-                    case PieceType::ROOK:   moves = get_rook_moves(x, y, p); break;
-                    case PieceType::QUEEN:  moves = get_queen_moves(x, y, p); break;
-                    default: break;
-                }
-
-                for (auto& m : moves)
-                {
-                    if (m.to == compact_coords(kx, ky))
-                    {
-                        in_check = true;
-                        break;
-                    }
-                }
-                break;
-            }
-        }
-    }
+    while (true)
+    {
+        d ++;
+        gain[d] = on_square - gain[d - 1]; // if the piece on the square is taken
 
-    // Undo move (ALWAYS)
-    board[from_x][from_y] = moved;
-    board[to_x][to_y] = captured;
+        // Neither side can improve on this by continuing
+        if (std::max(-gain[d - 1], gain[d]) < 0)
+            break;
 
-    return in_check;
-}
+        Bitboard ours = attackers & occupancy[side];
+        if (!ours || d == 31)
+            break;
 
-bool ChessBoard::is_valid_move(const Move* move)
-{
-    // Ensure the "from" square actually has the piece
-    uint8_t from_x = move->from >> 4;
-    uint8_t from_y = move->from & 0x0F;
-    const ChessPiece& p = board[from_x][from_y];
+        int t = 0;
+        while (!(ours & p[side][t]))
+            t ++;
 
-    if (p.type == PieceType::NONE)
-        return false;
+        int sq = lsb(ours & p[side][t]);
+        occ ^= square_bb(sq);
 
-    if (p.color != turn)
-        return false;
+        // Sliders lined up behind the capturer join in
+        if (t == type_index(PieceType::PAWN) || t == type_index(PieceType::BISHOP) || t == type_index(PieceType::QUEEN))
+            attackers |= bishop_attacks(to, occ) & diagonal;
+        if (t == type_index(PieceType::ROOK) || t == type_index(PieceType::QUEEN))
+            attackers |= rook_attacks(to, occ) & orthogonal;
+        attackers &= occ;
 
-    // Generate all possible moves for this piece
-    std::vector<Move> possible_moves;
-    switch (p.type)
-    {
-        case PieceType::PAWN:   possible_moves = get_pawn_moves(from_x, from_y, p); break;
-        case PieceType::KNIGHT: possible_moves = get_knight_moves(from_x, from_y, p); break;
-        case PieceType::BISHOP: possible_moves = get_bishop_moves(from_x, from_y, p); break;
-        case PieceType::ROOK:   possible_moves = get_rook_moves(from_x, from_y, p); break;
-        case PieceType::QUEEN:  possible_moves = get_queen_moves(from_x, from_y, p); break;
-        case PieceType::KING:   possible_moves = get_king_moves(from_x, from_y, p); break;
-        default: return false;
+        on_square = SEE_VALUE[t];
+        side ^= 1;
     }
 
-    // Check if the move is among the possible moves
-    bool found = false;
-    for (auto& m : possible_moves)
-    {
-        if (m.to == move->to && m.from == move->from)
-        {
-            found = true;
-            break;
-        }
-    }
+    while (--d)
+        gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+    return gain[0];
+}
 
-    if (!found)
-        return false;
+bool ChessBoard::is_square_attacked(int sq, PieceColor by) const
+{
+    const Bitboard* p = pieces[color_index(by)];
+
+    // Look outwards from the square with each piece's attack pattern
+    if (PAWN_ATTACKS[color_index(by) ^ 1][sq] & p[type_index(PieceType::PAWN)])
+        return true;
+    if (KNIGHT_ATTACKS[sq] & p[type_index(PieceType::KNIGHT)])
+        return true;
+    if (KING_ATTACKS[sq] & p[type_index(PieceType::KING)])
+        return true;
+
+    Bitboard queens = p[type_index(PieceType::QUEEN)];
+    if (bishop_attacks(sq, occupied) & (p[type_index(PieceType::BISHOP)] | queens))
+        return true;
+    if (rook_attacks(sq, occupied) & (p[type_index(PieceType::ROOK)] | queens))
+        return true;
 
-    // Make the move temporarily to check if king is in check
-    make_move(move);
-    PieceColor mover =
-        (turn == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
-    bool leaves_king_in_check = is_check(mover);
-    undo_move();
+    return false;
+}
 
-    return !leaves_king_in_check;
+void ChessBoard::update_checkers()
+{
+    int us = color_index(turn);
+    int king_sq = king_square[us];
+    checkers = (king_sq == NO_SQUARE) ? 0 : attackers_to(king_sq, occupied) & occupancy[us ^ 1];
 }
 
 bool ChessBoard::is_check(PieceColor c)
 {
-    int kx = -1, ky = -1;
-
-    // Find king
-    for (int i = 0; i < 64; ++i)
-    {
-        int x = i % 8;
-        int y = i / 8;
-        if (board[x][y].type == PieceType::KING &&
-            board[x][y].color == c)
-        {
-            kx = x;
-            ky = y;
-            break;
-        }
-    }
+    if (c == turn)
+        return checkers != 0;
 
-    if (kx == -1)
+    int king_sq = king_square[color_index(c)];
+    if (king_sq == NO_SQUARE)
         return false; // no king found (invalid board)
 
     PieceColor enemy =
         (c == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
 
-    // Generate enemy moves only
-    for (int i = 0; i < 64; ++i)
-    {
-        int x = i % 8;
-        int y = i / 8;
-        ChessPiece p = board[x][y];
+    return is_square_attacked(king_sq, enemy);
+}
 
-        if (p.type == PieceType::NONE || p.color != enemy)
-            continue;
+bool ChessBoard::is_checkmate()
+{
+    if (!is_check(turn))
+        return false;
 
-        std::vector<Move> moves;
-        switch (p.type)
-        {
-            case PieceType::PAWN:   moves = get_pawn_moves(x, y, p); break;
-            case PieceType::KNIGHT: moves = get_knight_moves(x, y, p); break;
-            case PieceType::BISHOP: moves = get_bishop_moves(x, y, p); break;
-            case PieceType::ROOK:   moves = get_rook_moves(x, y, p); break;
-            case PieceType::QUEEN:  moves = get_queen_moves(x, y, p); break;
-            case PieceType::KING:   moves = get_king_moves(x, y, p); break;
-            default:
-                break;
-        }
+    MoveList moves;
+    get_legal_moves(moves);
+    return moves.empty();
+}
 
-        for (auto& m : moves)
-        {
-            if (m.to == compact_coords(kx, ky))
-                return true;
-        }
-    }
-    return false;
+std::string move_to_string(const Move& m)
+{
+    std::string s = {
+        char('a' + square_x(m.from())), char('1' + square_y(m.from())),
+        char('a' + square_x(m.to())),   char('1' + square_y(m.to()))
+    };
+
+    if (m.is_promotion())
+        s += "nbrq"[m.flags() & 3];
+
+    return s;
 }
 
-bool ChessBoard::is_checkmate()
+bool ChessBoard::parse_move(const std::string& text, Move& move)
 {
-    if (!is_check(turn))
+    if (text.size() < 4)
         return false;
 
-    auto moves = get_moves();
+    MoveList moves;
+    get_legal_moves(moves);
+
+    // A promotion without a piece letter is taken to be a queen
     for (auto& m : moves)
     {
-        if (m.p.color != turn)
-            continue;
-
-        make_move(&m);
-        bool still_in_check = is_check(turn);
-        undo_move();
-
-        if (!still_in_check)
-            return false;
+        std::string s = move_to_string(m);
+        if (s == text || (text.size() == 4 && s == text + "q"))
+        {
+            move = m;
+            return true;
+        }
     }
-    return true;
+    return false;
 }
 
 static char piece_to_char(const ChessPiece& p)
@@ -1,13 +1,11 @@
 #include "engine.hpp"
 
-static const float PAWN_VALUE   = 1.00;
-static const float KNIGHT_VALUE = 2.93;
-static const float BISHOP_VALUE = 3.00;
-static const float ROOK_VALUE   = 4.56;
-static const float QUEEN_VALUE  = 9.05;
-static const float KING_VALUE = 1000.0f;
+#include "movepick.hpp"
 
-constexpr float MATE_SCORE = 100000.0f; // Score for checkmate
+#include <cstring>
+#include <thread>
+
+static const int INFINITE = MATE_SCORE + 1;
 
 // Interesting move config
 static const float INTERESTING_MOVE_THRESHHOLD = 1.0f; // If interesting score less than this, decrease depth
@@ -15,181 +13,421 @@ static const float CHECK_WEIGHT   = 2.0f;
 static const float CAPTURE_WEIGHT = 0.5f;
 
 static const int QUIESCENCE_MAX = 3;
-
-static const float BOARD_SCALING = 10.00; // divide table values by this
-static const int depth = 5;
-
-// Pawn
-static const int PAWN_TABLE[8][8] =
-{
-    { 0,   0,   0,   0,   0,   0,   0,   0 },
-    { 10,  10,  10,  10,  10,  10,  10,  10 },
-    { 5,   5,   10,  25,  25,  10,  5,   5 },
-    { 0,   0,   0,   20,  20,  0,   0,   0 },
-    { 5,  -5,  -10,  0,   0,  -10, -5,  5 },
-    { 5,   10,  10, -20, -20,  10,  10,  5 },
-    { 10,  10,  20, -20, -20,  20,  10,  10 },
-    { 0,   0,   0,   0,   0,   0,   0,   0 }
-};
-
-// Knight
-static const int KNIGHT_TABLE[8][8] =
-{
-    {-50, -40, -30, -30, -30, -30, -40, -50},
-    {-40, -20, 0,   5,   5,   0,  -20, -40},
-    {-30,  5,  10, 15,  15, 10,   5,  -30},
-    {-30,  0,  15, 20,  20, 15,   0,  -30},
-    {-30,  5,  15, 20,  20, 15,   5,  -30},
-    {-30,  0,  10, 15,  15, 10,   0,  -30},
-    {-40, -20, 0,   0,   0,   0,  -20, -40},
-    {-50, -40, -30, -30, -30, -30, -40, -50}
-};
-
-// Bishop
-static const int BISHOP_TABLE[8][8] =
-{
-    {-20, -10, -10, -10, -10, -10, -10, -20},
-    {-10,   5,  0,   0,   0,   0,   5, -10},
-    {-10,  10, 10,  10,  10,  10,  10, -10},
-    {-10,   0, 10,  10,  10,  10,   0, -10},
-    {-10,   5,  5,  10,  10,   5,   5, -10},
-    {-10,   0,  5,  10,  10,   5,   0, -10},
-    {-10,   0,  0,   0,   0,   0,   0, -10},
-    {-20, -10, -10, -10, -10, -10, -10, -20}
-};
-
-// Rook
-static const int ROOK_TABLE[8][8] =
-{
-    { 0,   0,   0,   5,   5,   0,   0,   0 },
-    {-5,   0,   0,   0,   0,   0,   0,  -5 },
-    {-5,   0,   0,   0,   0,   0,   0,  -5 },
-    {-5,   0,   0,   0,   0,   0,   0,  -5 },
-    {-5,   0,   0,   0,   0,   0,   0,  -5 },
-    {-5,   0,   0,   0,   0,   0,   0,  -5 },
-    { 5,  10,  10,  10,  10,  10,  10,   5 },
-    { 0,   0,   0,   0,   0,   0,   0,   0 }
-};
-
-// Queen
-static const int QUEEN_TABLE[8][8] =
-{
-    {-20, -10, -10, -5,  -5, -10, -10, -20},
-    {-10,   0,   5,  0,   0,   0,   0, -10},
-    {-10,   5,   5,  5,   5,   5,   0, -10},
-    { 0,    0,   5,  5,   5,   5,   0,  -5},
-    {-5,    0,   5,  5,   5,   5,   0,  -5},
-    {-10,   0,   5,  5,   5,   5,   0, -10},
-    {-10,   0,   0,   0,   0,   0,   0, -10},
-    {-20, -10, -10, -5,  -5, -10, -10, -20}
-};
-
-// King (middle game)
-static const int KING_TABLE[8][8] =
-{
-    {-30, -40, -40, -50, -50, -40, -40, -30},
-    {-30, -40, -40, -50, -50, -40, -40, -30},
-    {-30, -40, -40, -50, -50, -40, -40, -30},
-    {-30, -40, -40, -50, -50, -40, -40, -30},
-    {-20, -30, -30, -40, -40, -30, -30, -20},
-    {-10, -20, -20, -20, -20, -20, -20, -10},
-    { 20,  20,   0,   0,   0,   0,  20,  20},
-    { 20,  30,  10,   0,   0,  10,  30,  20}
-};
+static const int DELTA_MARGIN   = 200; // quiescence skips captures that cannot lift alpha by this
+
+// Forward pruning, margins in centipawns
+static const int RFP_MAX_DEPTH      = 6;
+static const int RFP_MARGIN         = 80;  // per ply of remaining depth
+static const int NULL_MIN_DEPTH     = 3;
+static const int NULL_REDUCTION     = 3;   // plus one per NULL_DEPTH_DIVISOR plies
+static const int NULL_DEPTH_DIVISOR = 6;
+static const int NULL_VERIFY_DEPTH  = 10;  // from here a null move cutoff is verified
+
+// Aspiration windows (centipawns), the root is searched around the last score
+static const int ASPIRATION_MIN_DEPTH = 4;
+static const int ASPIRATION_WINDOW    = 25;
+static const int ASPIRATION_MAX       = 500; // wider than this falls back to a full window
+
+static const int KING_SHIELD_BONUS = 10; // per own pawn next to the king
+static const int DEFAULT_DEPTH = 5;
+static const int MAX_DEPTH = 64;
+
+// Time management (ms)
+static const int64_t MOVE_OVERHEAD = 30;
+static const int DEFAULT_MOVES_TO_GO = 30;
+
+// The tables assume no castling rights, and Position needs both kings
+static bool tablebase_position(const ChessBoard* board, int cardinality)
+{
+    return cardinality && !board->castling_rights() && popcount(board->occupied) <= cardinality &&
+           board->king_square[0] != NO_SQUARE && board->king_square[1] != NO_SQUARE;
+}
 
 ChessEngine::ChessEngine()
-{}
+{
+    set_threads(1);
+}
 
 ChessEngine::~ChessEngine()
 {}
 
+void ChessEngine::set_hash_size(size_t mb)
+{
+    tt.resize(mb);
+}
+
+void ChessEngine::set_threads(int count)
+{
+    threads.clear();
+    for (int i = 0; i < std::max(1, count); i ++)
+    {
+        threads.push_back(std::make_unique<SearchThread>());
+        threads.back()->id = i;
+    }
+}
+
+void ChessEngine::clear_hash()
+{
+    tt.clear();
+    for (auto& t : threads)
+        t->clear_heuristics();
+}
+
+int ChessEngine::set_syzygy_path(const std::string& paths)
+{
+    tablebases.init(paths);
+    return tablebases.size();
+}
+
+void ChessEngine::set_info_callback(std::function<void(const SearchInfo&)> callback)
+{
+    info_callback = std::move(callback);
+}
+
 Move ChessEngine::make_move(const ChessBoard* board)
 {
-    const Move m = search(board, depth);
-    return m;
+    SearchLimits limits;
+    limits.depth = DEFAULT_DEPTH;
+    return make_move(board, limits);
+}
+
+Move ChessEngine::make_move(const ChessBoard* position, const SearchLimits& limits)
+{
+    start_clock(limits, position->turn);
+    return think(position, limits);
+}
+
+Move ChessEngine::think(const ChessBoard* position, const SearchLimits& limits)
+{
+    // Thrown here rather than by make_move inside a search thread
+    if (position->game_ply() > MAX_GAME_PLY)
+        throw std::length_error("Game too long to search");
+
+    tt.new_search();
+
+    int max_depth = limits.depth ? std::min(limits.depth, MAX_DEPTH) : MAX_DEPTH;
+
+    for (auto& t : threads)
+    {
+        t->board = *position; // copy board
+        t->board.refresh_accumulator(); // the network may have changed since the position was set
+        t->nodes = 0;
+        t->tb_hits = 0;
+        t->best_move = Move{};
+        t->best_score = 0;
+        t->completed_depth = 0;
+        t->new_search();
+    }
+
+    // DTZ leaves only the root moves that keep the best tablebase result
+    root_moves.clear();
+    if (tablebase_position(position, tablebases.cardinality()))
+    {
+        Position root(*position);
+        root.get_legal_moves(root_moves);
+        if (!tablebases.filter_root_moves(root, root_moves))
+            root_moves.clear();
+    }
+
+    // Lazy SMP: helpers run the same iterative deepening on their own board and
+    // feed the main thread through the shared hash table
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < threads.size(); i ++)
+        helpers.emplace_back(&ChessEngine::iterate, this, threads[i].get(), max_depth);
+
+    iterate(threads[0].get(), max_depth);
+
+    stopped = true;
+    for (auto& h : helpers)
+        h.join();
+
+    // Prefer the deepest completed result, the main thread on ties
+    SearchThread* best = threads[0].get();
+    for (auto& t : threads)
+    {
+        if (t->completed_depth > best->completed_depth)
+            best = t.get();
+    }
+
+    return best->best_move;
+}
+
+void ChessEngine::iterate(SearchThread* thread, int max_depth)
+{
+    // Helpers start at alternating depths so the threads spread over the tree
+    for (int d = 1 + (thread->id & 1); d <= max_depth; d ++)
+    {
+        int score;
+        Move m = aspiration(thread, d, score);
+
+        // Iterative deepening: each finished iteration seeds the next through the
+        // hash table, an aborted one is thrown away in favour of the last result
+        if (stopped && thread->completed_depth)
+            break;
+
+        thread->best_move = m;
+        thread->best_score = score;
+        if (stopped)
+            break;
+        thread->completed_depth = d;
+
+        if (thread->id != 0)
+            continue;
+
+        report(thread);
+
+        if (time_up(soft_limit))
+            break;
+    }
 }
 
-float ChessEngine::eval(const ChessBoard* position)
+Move ChessEngine::aspiration(SearchThread* thread, int depth, int& score)
 {
-    float score = 0.0f;
+    if (depth < ASPIRATION_MIN_DEPTH || std::abs(thread->best_score) >= MATE_IN_MAX)
+        return search(thread, depth, -INFINITE, INFINITE, score);
 
-    for (int x = 0; x < 8; ++x)
+    int delta = ASPIRATION_WINDOW;
+    int alpha = thread->best_score - delta;
+    int beta  = thread->best_score + delta;
+
+    while (true)
     {
-        for (int y = 0; y < 8; ++y)
+        Move m = search(thread, depth, alpha, beta, score);
+        if (stopped)
+            return m;
+
+        // Widen the side that failed, until the score lands inside the window
+        delta *= 2;
+        if (score <= alpha)
+            alpha = delta > ASPIRATION_MAX ? -INFINITE : std::max(score - delta, -INFINITE);
+        else if (score >= beta)
         {
-            const ChessPiece& p = position->board[x][y];
-            if (p.type == PieceType::NONE)
-                continue;
+            beta = delta > ASPIRATION_MAX ? INFINITE : std::min(score + delta, INFINITE);
+
+            // A fail high already found a better move, keep it for an abort
+            thread->best_move = m;
+        }
+        else
+            return m;
+    }
+}
 
-            // Flip tables for black
-            int ty = (p.color == PieceColor::WHITE) ? y : 7 - y;
+void ChessEngine::report(SearchThread* thread)
+{
+    if (!info_callback)
+        return;
+
+    SearchInfo info;
+    info.depth    = thread->completed_depth;
+    info.score    = thread->best_score;
+    info.nodes    = node_count();
+    info.tbhits   = tb_hit_count();
+    info.time     = elapsed();
+    info.hashfull = tt.hashfull();
+    get_pv(&thread->board, thread->completed_depth, info.pv);
+
+    // The hash move may have been overwritten, the root result is authoritative
+    const Move& best = thread->best_move;
+    if (best.is_null())
+        info.pv.clear();
+    else if (info.pv.empty() || info.pv[0] != best)
+        info.pv.assign(1, best);
+
+    info_callback(info);
+}
 
-            float value = 0.00f;
-            switch (p.type)
+void ChessEngine::get_pv(const ChessBoard* position, int max_length, std::vector<Move>& pv)
+{
+    ChessBoard board = *position;
+    pv.clear();
+
+    // Follow hash moves from the root while they stay legal
+    TTEntry entry;
+    while ((int)pv.size() < max_length && tt.probe(board.hash, entry) && !entry.move.is_null())
+    {
+        MoveList moves;
+        board.get_legal_moves(moves);
+
+        const Move* found = nullptr;
+        for (auto& m : moves)
+        {
+            if (m == entry.move)
             {
-                case PieceType::PAWN:
-                    value = PAWN_VALUE;
-                    value += PAWN_TABLE[x][ty] / BOARD_SCALING;
-                    break;
-
-                case PieceType::KNIGHT:
-                    value = KNIGHT_VALUE;
-                    value += KNIGHT_TABLE[x][ty] / BOARD_SCALING;
-                    break;
-
-                case PieceType::BISHOP:
-                    value = BISHOP_VALUE;
-                    value += BISHOP_TABLE[x][ty] / BOARD_SCALING;
-                    break;
-
-                case PieceType::ROOK:
-                    value = ROOK_VALUE;
-                    value += ROOK_TABLE[x][ty] / BOARD_SCALING;
-                    break;
-                    
-                case PieceType::QUEEN:
-                    value = QUEEN_VALUE;
-                    value += QUEEN_TABLE[x][ty] / BOARD_SCALING;
-                    break;
-
-                case PieceType::KING:
-                {
-                    value = KING_VALUE;
-                    value += KING_TABLE[x][ty] / BOARD_SCALING;
-
-                    int shield = 0;
-                    for (int dx = -1; dx <= 1; dx++)
-                    for (int dy = -1; dy <= 1; dy++)
-                    {
-                        int nx = x + dx;
-                        int ny = y + dy;
-                        if (nx < 0 || nx >= 8 || ny < 0 || ny >= 8) continue;
-                        if (position->board[nx][ny].type == PieceType::PAWN &&
-                            position->board[nx][ny].color == p.color)
-                            shield++;
-                    }
-
-                    value += shield * 0.1f;
-                    break;
-                }
-
-                default:
-                    break;
+                found = &m;
+                break;
             }
-
-            if (p.color == PieceColor::WHITE)
-                score += value;
-            else
-                score -= value;
         }
+
+        if (!found)
+            break;
+
+        pv.push_back(*found);
+        board.make_move(found);
+    }
+}
+
+void ChessEngine::stop()
+{
+    stopped = true;
+}
+
+void ChessEngine::ponderhit()
+{
+    // The search keeps its tree and hash entries, only the clock starts now
+    limit_start = elapsed();
+    pondering = false;
+}
+
+bool ChessEngine::is_pondering() const
+{
+    return pondering;
+}
+
+int64_t ChessEngine::elapsed() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_time).count();
+}
+
+uint64_t ChessEngine::node_count() const
+{
+    uint64_t total = 0;
+    for (auto& t : threads)
+        total += t->nodes.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint64_t ChessEngine::tb_hit_count() const
+{
+    uint64_t total = 0;
+    for (auto& t : threads)
+        total += t->tb_hits.load(std::memory_order_relaxed);
+    return total;
+}
+
+int ChessEngine::depth_reached() const
+{
+    int depth = 0;
+    for (auto& t : threads)
+        depth = std::max(depth, t->completed_depth);
+    return depth;
+}
+
+void ChessEngine::start_clock(const SearchLimits& limits, PieceColor us)
+{
+    start_time = std::chrono::steady_clock::now();
+    stopped    = false;
+    node_limit = limits.nodes;
+    soft_limit = 0;
+    hard_limit = 0;
+    limit_start = 0;
+    pondering  = limits.ponder;
+
+    if (limits.infinite)
+        return;
+
+    if (limits.movetime)
+    {
+        soft_limit = hard_limit = std::max<int64_t>(1, limits.movetime - MOVE_OVERHEAD);
+        return;
+    }
+
+    int64_t remaining = (us == PieceColor::WHITE) ? limits.wtime : limits.btime;
+    int64_t increment = (us == PieceColor::WHITE) ? limits.winc : limits.binc;
+    if (!remaining)
+        return;
+
+    int moves_to_go = limits.movestogo ? limits.movestogo : DEFAULT_MOVES_TO_GO;
+    int64_t usable  = std::max<int64_t>(1, remaining - MOVE_OVERHEAD);
+
+    // Aim for an even share of the clock, but let a running iteration overrun it
+    soft_limit = std::min(usable, usable / moves_to_go + increment * 3 / 4);
+    hard_limit = std::min(usable, soft_limit * 4);
+    soft_limit = std::max<int64_t>(1, soft_limit / 2);
+}
+
+void ChessEngine::check_limits()
+{
+    if (time_up(hard_limit) ||
+        (node_limit && node_count() >= node_limit))
+        stopped = true;
+}
+
+bool ChessEngine::time_up(int64_t limit) const
+{
+    return limit && !pondering && elapsed() - limit_start >= limit;
+}
+
+void SearchThread::new_search()
+{
+    // Killers are position specific, history only loses some of its weight
+    std::fill(&killers[0][0], &killers[0][0] + MAX_PLY * 2, Move{});
+    for (auto& side : history)
+        for (auto& from : side)
+            for (int& h : from)
+                h /= 2;
+}
+
+void SearchThread::clear_heuristics()
+{
+    std::fill(&killers[0][0], &killers[0][0] + MAX_PLY * 2, Move{});
+    std::memset(history, 0, sizeof(history));
+    std::fill(&counter_moves[0][0][0], &counter_moves[0][0][0] + 2 * 6 * 64, Move{});
+    std::fill(move_stack, move_stack + MAX_PLY, Move{});
+}
+
+int ChessEngine::eval(const ChessBoard* position)
+{
+    // A loaded network replaces the hand-written evaluation
+    if (NNUE_NET && position->king_square[0] != NO_SQUARE && position->king_square[1] != NO_SQUARE)
+    {
+        int score = nnue_evaluate(position->accumulator, color_index(position->turn));
+        return position->turn == PieceColor::WHITE ? score : -score;
     }
 
+    // Material and piece-square values are summed incrementally by the board
+    int score = position->psq_score;
+
+    for (int c = 0; c < 2; c ++)
+    {
+        int king_sq = position->king_square[c];
+        if (king_sq == NO_SQUARE)
+            continue;
+
+        Bitboard pawns  = position->pieces[c][type_index(PieceType::PAWN)];
+        int shield = popcount(KING_ATTACKS[king_sq] & pawns) * KING_SHIELD_BONUS;
+        score += (c == 0) ? shield : -shield;
+    }
+
+    return score;
+}
+
+// Mate and tablebase scores are stored relative to the node, not the root
+static inline int score_to_tt(int score, int ply)
+{
+    if (score >= TB_WIN_IN_MAX)  return score + ply;
+    if (score <= -TB_WIN_IN_MAX) return score - ply;
+    return score;
+}
+
+static inline int score_from_tt(int score, int ply)
+{
+    if (score >= TB_WIN_IN_MAX)  return score - ply;
+    if (score <= -TB_WIN_IN_MAX) return score + ply;
     return score;
 }
 
-float ChessEngine::quiescence(ChessBoard* board, float alpha, float beta, int depth)
+int ChessEngine::quiescence(SearchThread* thread, int alpha, int beta, int depth)
 {
-    float stand_pat = eval(board);
+    ChessBoard* board = &thread->board;
+
+    thread->count_node();
+    if ((thread->nodes & 1023) == 0)
+        check_limits();
+    if (stopped)
+        return 0;
+
+    int stand_pat = eval(board);
     int turn_mul = (board->turn == PieceColor::WHITE) ? 1 : -1;
     stand_pat *= turn_mul;
 
@@ -201,27 +439,26 @@ float ChessEngine::quiescence(ChessBoard* board, float alpha, float beta, int de
     if (stand_pat > alpha)
         alpha = stand_pat;
 
-    PieceColor us = board->turn;
+    // Delta pruning: not even winning a queen would reach alpha
+    if (stand_pat + QUEEN_VALUE + DELTA_MARGIN < alpha)
+        return alpha;
 
-    for (auto& m : board->get_moves())
-    {
-        if (m.p.color != us)
-            continue;
+    MoveList moves;
+    board->get_legal_moves(moves);
 
-        // Only captures
-        uint8_t tx = (m.to >> 4) & 0xF;
-        uint8_t ty = m.to & 0xF;
-        if (board->board[tx][ty].type == PieceType::NONE)
+    // Captures and promotions that SEE does not lose, best victim first
+    MovePicker picker(board, moves);
+    while (const Move* next = picker.next())
+    {
+        const Move m = *next;
+        // Promotions always count, en passant is the only capture of an empty square
+        PieceType victim = board->piece_on(m.to()).type;
+        int gain = (victim == PieceType::NONE) ? PAWN_VALUE : PIECE_VALUE[type_index(victim)];
+        if (!m.is_promotion() && stand_pat + gain + DELTA_MARGIN <= alpha)
             continue;
 
         board->make_move(&m);
-        if (board->is_check(us))
-        {
-            board->undo_move();
-            continue;
-        }
-
-        float score = -quiescence(board, -beta, -alpha, depth - 1);
+        int score = -quiescence(thread, -beta, -alpha, depth - 1);
         board->undo_move();
 
         if (score >= beta)
@@ -233,58 +470,90 @@ float ChessEngine::quiescence(ChessBoard* board, float alpha, float beta, int de
     return alpha;
 }
 
-Move ChessEngine::search(const ChessBoard* position, int depth)
+Move ChessEngine::search(SearchThread* thread, int depth, int alpha, int beta, int& best_score)
 {
-    ChessBoard board = *position; // copy board
+    ChessBoard* board = &thread->board;
     Move best_move{};
-    float best_score = -1e9f;
+    best_score = -INFINITE;
 
-    auto moves = board.get_moves();
+    MoveList moves;
+    board->get_legal_moves(moves);
     if (moves.empty())
     {
-        return Move{}; // or throw, or mark as resign
+        // Nothing to play: mated or stalemated at the root
+        best_score = board->is_check(board->turn) ? -MATE_SCORE : 0;
+        return Move{};
     }
-    for (auto& m : moves)
+    if (!root_moves.empty())
+        moves = root_moves;
+    best_move = moves[0];
+
+    // Search the previous best move first
+    TTEntry entry;
+    if (tt.probe(board->hash, entry))
     {
-        if (m.p.color != position->turn)
-            continue;
+        for (auto& m : moves)
+        {
+            if (m == entry.move)
+            {
+                std::swap(m, moves[0]);
+                break;
+            }
+        }
+    }
 
-        PieceColor us = m.p.color;
+    const int alpha_orig = alpha;
 
-        board.make_move(&m);
-        if (board.is_check(us))
+    for (int i = 0; i < moves.size(); i ++)
+    {
+        Move& m = moves[i];
+        thread->move_stack[0] = m;
+        board->make_move(&m);
+
+        // PVS: the first move gets the full window, the rest only have to
+        // prove they are no better and are re-searched if they are
+        int score;
+        if (i == 0)
+            score = -negamax(thread, depth - 1, 1, -beta, -alpha);
+        else
         {
-            board.undo_move();
-            continue;
+            score = -negamax(thread, depth - 1, 1, -alpha - 1, -alpha);
+            if (score > alpha && score < beta && !stopped)
+                score = -negamax(thread, depth - 1, 1, -beta, -alpha);
         }
 
-        float score = -negamax(
-            &board,
-            depth - 1,
-            -1e9f,
-            1e9f
-        );
+        board->undo_move();
 
-        board.undo_move();
+        if (stopped)
+            break;
 
         if (score > best_score)
         {
             best_score = score;
             best_move = m;
         }
+        alpha = std::max(alpha, score);
+
+        if (alpha >= beta)
+            break;
     }
 
+    if (!stopped)
+    {
+        Bound bound = (best_score <= alpha_orig) ? Bound::UPPER
+                    : (best_score >= beta)       ? Bound::LOWER
+                                                 : Bound::EXACT;
+        tt.store(board->hash, depth, bound, best_score, bound == Bound::UPPER ? nullptr : &best_move);
+    }
     return best_move;
 }
 
+// Called with m already made on the board, captured is the piece it took
 static inline float is_interesting(
     ChessBoard* board,
-    const Move& m)
+    ChessPiece captured)
 {
     float interesting = 0.00f;
-    uint8_t capture_x = (m.to >> 4) & 0x0f;
-    uint8_t capture_y = m.to & 0x0f;
-    ChessPiece captured = board->board[capture_x][capture_y];
 
     // Captures
     if (captured.type != PieceType::NONE)
@@ -294,96 +563,223 @@ static inline float is_interesting(
     //if (promotion != PieceType::NONE)
     //    return true;
 
-    // Checks
-    PieceColor them =
-        (m.p.color == PieceColor::WHITE)
-            ? PieceColor::BLACK
-            : PieceColor::WHITE;
-
-    board->make_move((Move*)&m);
-    bool gives_check = board->is_check(them);
-    board->undo_move();
+    // Checks (the opponent is now the side to move)
+    bool gives_check = board->is_check(board->turn);
 
     interesting += gives_check * CHECK_WEIGHT;
     return interesting;
 }
 
-static inline int move_score(ChessBoard* board, const Move& m)
+// Null move pruning is unsound in zugzwang, which is mostly a pawn ending thing
+static inline bool has_non_pawn_material(const ChessBoard* board, PieceColor c)
 {
-    int score = 0;
+    const Bitboard* p = board->pieces[color_index(c)];
+    return p[type_index(PieceType::KNIGHT)] | p[type_index(PieceType::BISHOP)] |
+           p[type_index(PieceType::ROOK)]   | p[type_index(PieceType::QUEEN)];
+}
 
-    uint8_t tx = (m.to >> 4) & 0xF;
-    uint8_t ty = m.to & 0xF;
-    ChessPiece cap = board->board[tx][ty];
+// The stored reply to the opponent's last move, if any
+static inline Move counter_move(const SearchThread* thread, int ply)
+{
+    const Move& prev = thread->move_stack[ply - 1];
+    if (prev.is_null())
+        return Move{};
 
-    // Captures first
-    if (cap.type != PieceType::NONE)
-        score += 1000 + int(cap.type) * 10;
+    // The previous move has been made, its piece stands on the destination
+    ChessPiece p = thread->board.piece_on(prev.to());
+    return thread->counter_moves[color_index(p.color)][type_index(p.type)][prev.to()];
+}
 
-    // Promotions
-    if (m.p.type == PieceType::PAWN &&
-        (ty == 0 || ty == 7))
-        score += 800;
+// History gravity: bonuses shrink as a score nears HISTORY_MAX, so it stays bounded
+static inline void update_history(int& entry, int bonus)
+{
+    entry += bonus - entry * std::abs(bonus) / HISTORY_MAX;
+}
 
-    return score;
+// A quiet move caused a beta cutoff: remember it as killer and counter move,
+// reward it and penalise the quiet moves searched before it
+static void update_quiet_heuristics(
+    SearchThread* thread,
+    int ply,
+    int depth,
+    const Move& m,
+    const Move* quiets_tried,
+    int quiet_count)
+{
+    Move* killers = thread->killers[ply];
+    if (killers[0] != m)
+    {
+        killers[1] = killers[0];
+        killers[0] = m;
+    }
+
+    const Move& prev = thread->move_stack[ply - 1];
+    if (!prev.is_null())
+    {
+        ChessPiece p = thread->board.piece_on(prev.to());
+        thread->counter_moves[color_index(p.color)][type_index(p.type)][prev.to()] = m;
+    }
+
+    int (*history)[64] = thread->history[color_index(thread->board.turn)];
+    int bonus = std::min(depth * depth, HISTORY_MAX / 4);
+
+    update_history(history[m.from()][m.to()], bonus);
+    for (int i = 0; i < quiet_count; i ++)
+        update_history(history[quiets_tried[i].from()][quiets_tried[i].to()], -bonus);
 }
 
-float ChessEngine::negamax(
-    ChessBoard* board,
+int ChessEngine::negamax(
+    SearchThread* thread,
     int depth,
-    float alpha,
-    float beta)
+    int ply,
+    int alpha,
+    int beta,
+    bool allow_null)
 {
-    const int turn_multiplier = (board->turn == PieceColor::WHITE) ? 1 : -1;
-    if (depth == 0)
-        return quiescence(board, alpha, beta, QUIESCENCE_MAX);
+    ChessBoard* board = &thread->board;
+    if (depth <= 0)
+        return quiescence(thread, alpha, beta, QUIESCENCE_MAX);
+
+    thread->count_node();
+    if ((thread->nodes & 1023) == 0)
+        check_limits();
+    if (stopped)
+        return 0;
 
+    const int alpha_orig = alpha;
+
+    TTEntry entry;
+    bool tt_hit = tt.probe(board->hash, entry);
+    if (tt_hit && entry.depth >= depth)
+    {
+        int tt_score = score_from_tt(entry.score, ply);
+        if (entry.bound == Bound::EXACT ||
+            (entry.bound == Bound::LOWER && tt_score >= beta) ||
+            (entry.bound == Bound::UPPER && tt_score <= alpha))
+            return tt_score;
+    }
+
+    // The node type follows the window it was called with, before a
+    // tablebase win raises alpha
     PieceColor us = board->turn;
-    auto moves = board->get_moves();
+    bool in_check = board->is_check(us);
+    bool pv_node  = beta - alpha > 1;
 
-    bool has_legal = false;
-    for (auto& m : moves)
+    // Tablebase positions have an exact result, wins and losses only bound the
+    // score since a mate may still be found below
+    int tb_floor = -INFINITE, tb_ceiling = INFINITE;
+    if (tablebase_position(board, tablebases.cardinality()))
     {
-        if (m.p.color != us)
-            continue;
+        int wdl;
+        if (tablebases.probe_wdl(Position(*board), wdl))
+        {
+            thread->count_tb_hit();
+
+            // Cursed wins and blessed losses are drawn by the fifty move rule
+            int score = (wdl == WDL_WIN)  ?  TB_WIN_SCORE - ply
+                      : (wdl == WDL_LOSS) ? -TB_WIN_SCORE + ply
+                                          :  wdl;
+            Bound bound = (wdl == WDL_WIN)  ? Bound::LOWER
+                        : (wdl == WDL_LOSS) ? Bound::UPPER
+                                            : Bound::EXACT;
+
+            if (bound == Bound::EXACT ||
+                (bound == Bound::LOWER && score >= beta) ||
+                (bound == Bound::UPPER && score <= alpha))
+            {
+                tt.store(board->hash, depth, bound, score_to_tt(score, ply), nullptr);
+                return score;
+            }
 
-        board->make_move(&m);
-        if (!board->is_check(us))
-            has_legal = true;
-        board->undo_move();
+            // Otherwise the search goes on within the proven bound
+            if (bound == Bound::LOWER)
+            {
+                tb_floor = score;
+                alpha = std::max(alpha, score);
+            }
+            else
+                tb_ceiling = score;
+        }
+    }
 
-        if (has_legal)
-            break;
+    if (!pv_node && !in_check && std::abs(beta) < MATE_IN_MAX)
+    {
+        int static_eval = eval(board) * ((us == PieceColor::WHITE) ? 1 : -1);
+
+        // Reverse futility: far enough above beta that a quiet ply will not drop it
+        if (depth <= RFP_MAX_DEPTH && static_eval - RFP_MARGIN * depth >= beta)
+            return static_eval;
+
+        // Null move: if passing still fails high, a real move almost surely does
+        if (allow_null && depth >= NULL_MIN_DEPTH && static_eval >= beta &&
+            has_non_pawn_material(board, us))
+        {
+            int r = NULL_REDUCTION + depth / NULL_DEPTH_DIVISOR;
+
+            thread->move_stack[ply] = Move{};
+            board->make_null_move();
+            int score = -negamax(thread, depth - 1 - r, ply + 1, -beta, -beta + 1, false);
+            board->undo_null_move();
+
+            if (stopped)
+                return 0;
+
+            if (score >= beta)
+            {
+                // A mate found after passing is not proven
+                if (score >= MATE_IN_MAX)
+                    score = beta;
+
+                if (depth < NULL_VERIFY_DEPTH)
+                    return score;
+
+                // Deep cutoffs are checked by a reduced search without null moves
+                int verified = negamax(thread, depth - 1 - r, ply, beta - 1, beta, false);
+                if (stopped)
+                    return 0;
+                if (verified >= beta)
+                    return score;
+            }
+        }
     }
 
-    if (!has_legal)
+    MoveList moves;
+    board->get_legal_moves(moves);
+
+    if (moves.empty())
     {
-        if (board->is_check(us))
-            return turn_multiplier * (MATE_SCORE + depth); // mate sooner is better
+        if (in_check)
+            return -MATE_SCORE + ply; // mate sooner is better
         else
-            return 0.0f; // stalemate
+            return 0; // stalemate
     }
 
-    float best = -1e9f;
+    int best = -INFINITE;
+    Move best_move{};
     int move_index = 0;
-    std::sort(moves.begin(), moves.end(),
-        [&](const Move& a, const Move& b)
-        {
-            return move_score(board, a) > move_score(board, b);
-        });
-    for (auto& m : moves)
+
+    // Quiet moves that did not cut, they lose history if a later one does
+    Move quiets_tried[64];
+    int quiet_count = 0;
+
+    int us_index = color_index(us);
+    Move tt_move = tt_hit ? entry.move : Move{};
+
+    MovePicker picker(board, moves, tt_move, thread->killers[ply],
+                      counter_move(thread, ply), thread->history[us_index]);
+
+    while (const Move* next = picker.next())
     {
-        if (m.p.color != us)
-            continue;
+        const Move m = *next;
+        bool quiet = !m.is_capture() && !m.is_promotion();
+        ChessPiece captured = board->piece_on(m.to());
+        if (m.flags() == EP_CAPTURE)
+            captured.type = PieceType::PAWN; // the destination square is empty
 
+        thread->move_stack[ply] = m;
         board->make_move(&m);
-        if (board->is_check(us))
-        {
-            board->undo_move();
-            continue;
-        }
 
-        float interesting = is_interesting(board, m);
+        float interesting = is_interesting(board, captured);
 
         int new_depth = depth - 1;
 
@@ -393,24 +789,53 @@ float ChessEngine::negamax(
             new_depth -= 1; // reduce by 1 ply
         }
 
-        float score = -negamax(
-            board,
-            new_depth,
-            -beta,
-            -alpha
-        );
+        // PVS: only the first move is searched with the full window. Later moves
+        // get a null window, and a reduced or null window result that beats
+        // alpha is confirmed at full depth, then with the full window.
+        int score;
+        if (move_index == 0)
+            score = -negamax(thread, depth - 1, ply + 1, -beta, -alpha);
+        else
+        {
+            score = -negamax(thread, new_depth, ply + 1, -alpha - 1, -alpha);
+            if (score > alpha && new_depth < depth - 1)
+                score = -negamax(thread, depth - 1, ply + 1, -alpha - 1, -alpha);
+            if (score > alpha && score < beta)
+                score = -negamax(thread, depth - 1, ply + 1, -beta, -alpha);
+        }
 
         board->undo_move();
 
-        best = std::max(best, score);
+        // Unwind without touching the hash table, the score is meaningless
+        if (stopped)
+            return 0;
+
+        if (score > best)
+        {
+            best = score;
+            best_move = m;
+        }
         alpha = std::max(alpha, score);
 
         if (alpha >= beta)
+        {
+            if (quiet)
+                update_quiet_heuristics(thread, ply, depth, m, quiets_tried, quiet_count);
             break;
+        }
+
+        if (quiet && quiet_count < 64)
+            quiets_tried[quiet_count++] = m;
 
         move_index++;
     }
 
+    best = std::clamp(best, tb_floor, tb_ceiling);
+
+    Bound bound = (best <= alpha_orig) ? Bound::UPPER
+                : (best >= beta)       ? Bound::LOWER
+                                       : Bound::EXACT;
+    tt.store(board->hash, depth, bound, score_to_tt(best, ply), bound == Bound::UPPER ? nullptr : &best_move);
 
     return best;
 }
@@ -0,0 +1,103 @@
+#include "eval.hpp"
+
+static constexpr int BOARD_SCALING = 10; // table values are in tenths of a pawn
+
+// Pawn
+static constexpr int PAWN_TABLE[8][8] =
+{
+    { 0,   0,   0,   0,   0,   0,   0,   0 },
+    { 10,  10,  10,  10,  10,  10,  10,  10 },
+    { 5,   5,   10,  25,  25,  10,  5,   5 },
+    { 0,   0,   0,   20,  20,  0,   0,   0 },
+    { 5,  -5,  -10,  0,   0,  -10, -5,  5 },
+    { 5,   10,  10, -20, -20,  10,  10,  5 },
+    { 10,  10,  20, -20, -20,  20,  10,  10 },
+    { 0,   0,   0,   0,   0,   0,   0,   0 }
+};
+
+// Knight
+static constexpr int KNIGHT_TABLE[8][8] =
+{
+    {-50, -40, -30, -30, -30, -30, -40, -50},
+    {-40, -20, 0,   5,   5,   0,  -20, -40},
+    {-30,  5,  10, 15,  15, 10,   5,  -30},
+    {-30,  0,  15, 20,  20, 15,   0,  -30},
+    {-30,  5,  15, 20,  20, 15,   5,  -30},
+    {-30,  0,  10, 15,  15, 10,   0,  -30},
+    {-40, -20, 0,   0,   0,   0,  -20, -40},
+    {-50, -40, -30, -30, -30, -30, -40, -50}
+};
+
+// Bishop
+static constexpr int BISHOP_TABLE[8][8] =
+{
+    {-20, -10, -10, -10, -10, -10, -10, -20},
+    {-10,   5,  0,   0,   0,   0,   5, -10},
+    {-10,  10, 10,  10,  10,  10,  10, -10},
+    {-10,   0, 10,  10,  10,  10,   0, -10},
+    {-10,   5,  5,  10,  10,   5,   5, -10},
+    {-10,   0,  5,  10,  10,   5,   0, -10},
+    {-10,   0,  0,   0,   0,   0,   0, -10},
+    {-20, -10, -10, -10, -10, -10, -10, -20}
+};
+
+// Rook
+static constexpr int ROOK_TABLE[8][8] =
+{
+    { 0,   0,   0,   5,   5,   0,   0,   0 },
+    {-5,   0,   0,   0,   0,   0,   0,  -5 },
+    {-5,   0,   0,   0,   0,   0,   0,  -5 },
+    {-5,   0,   0,   0,   0,   0,   0,  -5 },
+    {-5,   0,   0,   0,   0,   0,   0,  -5 },
+    {-5,   0,   0,   0,   0,   0,   0,  -5 },
+    { 5,  10,  10,  10,  10,  10,  10,   5 },
+    { 0,   0,   0,   0,   0,   0,   0,   0 }
+};
+
+// Queen
+static constexpr int QUEEN_TABLE[8][8] =
+{
+    {-20, -10, -10, -5,  -5, -10, -10, -20},
+    {-10,   0,   5,  0,   0,   0,   0, -10},
+    {-10,   5,   5,  5,   5,   5,   0, -10},
+    { 0,    0,   5,  5,   5,   5,   0,  -5},
+    {-5,    0,   5,  5,   5,   5,   0,  -5},
+    {-10,   0,   5,  5,   5,   5,   0, -10},
+    {-10,   0,   0,   0,   0,   0,   0, -10},
+    {-20, -10, -10, -5,  -5, -10, -10, -20}
+};
+
+// King (middle game)
+static constexpr int KING_TABLE[8][8] =
+{
+    {-30, -40, -40, -50, -50, -40, -40, -30},
+    {-30, -40, -40, -50, -50, -40, -40, -30},
+    {-30, -40, -40, -50, -50, -40, -40, -30},
+    {-30, -40, -40, -50, -50, -40, -40, -30},
+    {-20, -30, -30, -40, -40, -30, -30, -20},
+    {-10, -20, -20, -20, -20, -20, -20, -10},
+    { 20,  20,   0,   0,   0,   0,  20,  20},
+    { 20,  30,  10,   0,   0,  10,  30,  20}
+};
+
+// Tables are indexed [x][y] from white's point of view
+static constexpr PieceSquareTable make_psqt()
+{
+    const int (*tables[6])[8] = {
+        PAWN_TABLE, KNIGHT_TABLE, BISHOP_TABLE, ROOK_TABLE, QUEEN_TABLE, KING_TABLE
+    };
+    PieceSquareTable psqt{};
+    for (int t = 0; t < 6; t ++)
+    {
+        for (int sq = 0; sq < 64; sq ++)
+        {
+            int x = sq & 7;
+            int y = sq >> 3;
+            psqt.value[0][t][sq] =   PIECE_VALUE[t] + tables[t][x][y]     * 100 / BOARD_SCALING;
+            psqt.value[1][t][sq] = -(PIECE_VALUE[t] + tables[t][x][7 - y] * 100 / BOARD_SCALING);
+        }
+    }
+    return psqt;
+}
+
+constinit const PieceSquareTable PSQT = make_psqt();
@@ -1,3 +1,4 @@
+#include "book.hpp"
 #include "chess.hpp"
 #include "engine.hpp"
 
@@ -5,6 +6,16 @@
 #include <string>
 #include <cctype>
 #include <cmath>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+static const int ENGINE_DEPTH = 5;   // depth the analysis must reach before "engine" plays
+static const int INPUT_TICK   = 100; // ms between redraws while waiting for keys
+static const int PV_LENGTH    = 6;   // moves shown in the side panel
+
+static const char* DEFAULT_BOOK = "book.bin"; // used when no book is given on the command line
 
 char piece_char(const ChessPiece& p)
 {
@@ -24,44 +35,94 @@ char piece_char(const ChessPiece& p)
     return (p.color == PieceColor::WHITE) ? c : tolower(c);
 }
 
-Move parse_move(const std::string& input, const ChessBoard& board)
+static inline std::string ltrim(const std::string& s)
 {
-    auto to_coord = [](char f, char r) -> uint8_t
+    size_t i = 0;
+    while (i < s.size() && std::isspace(s[i])) i++;
+    return s.substr(i);
+}
+
+// Background analysis of the position on screen. The engine runs on its own
+// thread and the latest completed iteration is kept for the UI to draw.
+class Analysis
+{
+private:
+    ChessEngine& engine;
+    std::thread worker;
+    std::atomic<bool> running = false;
+
+    std::mutex info_lock;
+    SearchInfo latest{};
+    Move result{};
+
+public:
+    Analysis(ChessEngine& engine) : engine(engine)
     {
-        int x = f - 'a';
-        int y = r - '1';
-        if (x < 0 || x >= 8 || y < 0 || y >= 8)
-            throw std::out_of_range("Invalid square");
-        return (x << 4) | y;
-    };
+        engine.set_info_callback([this](const SearchInfo& info)
+        {
+            std::lock_guard<std::mutex> guard(info_lock);
+            latest = info;
+        });
+    }
 
-    uint8_t from = to_coord(input[0], input[1]);
-    uint8_t to   = to_coord(input[2], input[3]);
-    uint8_t fx = from >> 4, fy = from & 0x0F;
+    ~Analysis()
+    {
+        stop();
+    }
 
-    ChessPiece p = board.board[fx][fy];
-    if (p.type == PieceType::NONE)
-        throw std::runtime_error("No piece at source");
+    void start(const ChessBoard& board)
+    {
+        stop();
 
-    return Move{p, to, from};
-}
+        latest = SearchInfo{};
+        result = Move{};
+        running = true;
 
-std::string coord_to_alg(uint8_t c)
-{
-    return { char('a' + (c >> 4)), char('1' + (c & 0x0F)) };
-}
+        SearchLimits limits;
+        limits.infinite = true;
 
-static inline std::string ltrim(const std::string& s)
-{
-    size_t i = 0;
-    while (i < s.size() && std::isspace(s[i])) i++;
-    return s.substr(i);
-}
+        engine.start_clock(limits, board.turn);
+        worker = std::thread([this, limits, position = board]()
+        {
+            Move best = engine.think(&position, limits);
+
+            std::lock_guard<std::mutex> guard(info_lock);
+            result = best;
+            running = false;
+        });
+    }
+
+    void stop()
+    {
+        engine.stop();
+
+        if (worker.joinable())
+            worker.join();
+    }
+
+    bool finished() const
+    {
+        return !running;
+    }
+
+    SearchInfo info()
+    {
+        std::lock_guard<std::mutex> guard(info_lock);
+        return latest;
+    }
+
+    // Best move of the deepest completed iteration, only valid once stopped
+    Move best_move()
+    {
+        std::lock_guard<std::mutex> guard(info_lock);
+        return result;
+    }
+};
 
 void draw_board(WINDOW* win,
                 const ChessBoard& board,
                 float eval,
-                const Move* best_move,
+                const SearchInfo& info,
                 const std::string& turn)
 {
     werase(win);
@@ -87,23 +148,35 @@ void draw_board(WINDOW* win,
     int panel_x = 22;
 
     mvwprintw(win, 1, panel_x, "Engine");
-    mvwprintw(win, 2, panel_x, "Best Move:");
 
-    if (best_move)
+    if (info.depth)
     {
-        std::string mv =
-            coord_to_alg(best_move->from) +
-            coord_to_alg(best_move->to);
-        mvwprintw(win, 3, panel_x + 2, "%s", mv.c_str());
+        std::string pv;
+        for (size_t i = 0; i < info.pv.size() && i < (size_t)PV_LENGTH; i ++)
+            pv += move_to_string(info.pv[i]) + " ";
+
+        if (std::abs(info.score) >= MATE_IN_MAX)
+        {
+            int plies = MATE_SCORE - std::abs(info.score);
+            mvwprintw(win, 2, panel_x, "Score: #%d", info.score > 0 ? (plies + 1) / 2 : -(plies / 2));
+        }
+        else
+            mvwprintw(win, 2, panel_x, "Score: %+0.2f", info.score / 100.0f);
+
+        mvwprintw(win, 3, panel_x, "Depth: %d", info.depth);
+        mvwprintw(win, 4, panel_x, "NPS:   %lluk",
+                  (unsigned long long)(info.time ? info.nodes / info.time : 0));
+        mvwprintw(win, 5, panel_x, "Best:  %s", info.pv.empty() ? "--" : move_to_string(info.pv[0]).c_str());
+        mvwprintw(win, 11, 2, "PV: %s", pv.c_str());
     }
     else
-        mvwprintw(win, 3, panel_x + 2, "--");
+        mvwprintw(win, 2, panel_x, "Thinking...");
 
     // Chess position eval
-    mvwprintw(win, 5, panel_x, "Eval: %+0.2f", eval);
+    mvwprintw(win, 7, panel_x, "Eval:  %+0.2f", eval);
 
     // Current turn
-    mvwprintw(win, 7, panel_x, "Turn: %s", turn.c_str());
+    mvwprintw(win, 8, panel_x, "Turn:  %s", turn.c_str());
 
     wrefresh(win);
 }
@@ -122,8 +195,15 @@ void draw_command(WINDOW* win, const std::string& input, const std::string& stat
     wrefresh(win);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // Optional Polyglot book, "engine" plays from it before searching
+    OpeningBook book;
+    book.open(argc > 1 ? argv[1] : DEFAULT_BOOK);
+
+    // Optional network weights, the hand-written evaluation is used without them
+    nnue_load(argc > 2 ? argv[2] : NNUE_DEFAULT_FILE);
+
     initscr();
     set_escdelay(25);
     curs_set(1);
@@ -135,72 +215,143 @@ int main()
     getmaxyx(stdscr, term_h, term_w);
 
     // Layout sizes
-    int board_w = 38;  // Board + side panel
-    int board_h = 12;
+    int board_w = 48;  // Board + side panel
+    int board_h = 13;
     int cmd_h   = 4;
     int cmd_y = term_h - cmd_h - 1;
 
     WINDOW* board_win = newwin(board_h, board_w, 1, 1);
     WINDOW* cmd_win   = newwin(cmd_h, term_w - 1, cmd_y, 1);
 
+    // Keys are polled so the search output keeps updating while the user types
+    keypad(cmd_win, TRUE);
+    wtimeout(cmd_win, INPUT_TICK);
+
     ChessBoard board;
     ChessEngine engine;
+    Analysis analysis(engine);
     board.load_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w");
 
     std::string input;
     std::string status;
     std::string turn;
-    char buffer[64];
 
-    float eval = engine.eval(&board);
-    Move best_move{};
-    bool has_best = false;
+    float eval = engine.eval(&board) / 100.0f;
+    bool engine_to_move = false; // "engine" waits for the analysis to reach ENGINE_DEPTH
+
+    analysis.start(board);
+
+    // Restarts the analysis after the position changed, false once the game is over
+    auto position_changed = [&]() -> bool
+    {
+        engine_to_move = false;
+        eval = engine.eval(&board) / 100.0f;
+
+        // A game that fills the undo stack ends like a checkmate
+        if (board.is_checkmate() || board.game_ply() >= MAX_GAME_PLY)
+        {
+            analysis.stop();
+            status = board.is_checkmate() ? "Checkmate!" : "Game too long";
+            turn = (board.turn == PieceColor::WHITE) ? "White" : "Black";
+            draw_board(board_win, board, eval, SearchInfo{}, turn);
+            draw_command(cmd_win, input, status);
+            return false;
+        }
+        else if (board.is_check(board.turn))
+        {
+            status += " (Check)";
+        }
+
+        analysis.start(board);
+        return true;
+    };
 
     while (true)
     {
+        SearchInfo info = analysis.info();
+
+        if (engine_to_move && (info.depth >= ENGINE_DEPTH || analysis.finished()))
+        {
+            analysis.stop();
+            Move best = analysis.best_move();
+            engine_to_move = false;
+
+            if (best.is_null())
+                status = "Engine has no move";
+            else
+            {
+                board.make_move(&best);
+                status = "Engine played " + move_to_string(best);
+
+                if (!position_changed())
+                    break;
+                continue;
+            }
+        }
+
         turn = (board.turn == PieceColor::WHITE) ? "White" : "Black";
-        draw_board(board_win, board, eval, has_best ? &best_move : nullptr, turn);
+        draw_board(board_win, board, eval, info, turn);
         draw_command(cmd_win, input, status);
 
-        echo();
-        curs_set(1);
-        wmove(cmd_win, 1, 11);
-        wgetnstr(cmd_win, buffer, sizeof(buffer) - 1);
-        noecho();
-        curs_set(0);
+        int key = wgetch(cmd_win);
+        if (key == ERR)
+            continue;
 
-        input = buffer;
+        if (key == KEY_BACKSPACE || key == 127 || key == 8)
+        {
+            if (!input.empty())
+                input.pop_back();
+            continue;
+        }
+        if (key != '\n' && key != KEY_ENTER)
+        {
+            if (std::isprint(key) && input.size() < 63)
+                input += (char)key;
+            continue;
+        }
+
+        // The analysis only restarts when the position changes
+        bool moved = false;
 
         if (input == "exit")
             break;
         else if (input == "undo")
         {
-            board.undo_move();
-            status = "Move undone";
+            if (board.game_ply() == 0)
+                status = "Nothing to undo";
+            else
+            {
+                board.undo_move();
+                status = "Move undone";
+                moved = true;
+            }
         }
         else if (input == "engine")
         {
-            best_move = engine.make_move(&board);
-            board.make_move(&best_move);
-            has_best = true;
-            status = "Engine played " + coord_to_alg(best_move.from) + coord_to_alg(best_move.to);
-        }
-        else if (input.size() == 4)
-        {
-            try
+            Move book_move;
+            if (book.probe(board, book_move))
             {
-                Move m = parse_move(input, board);
-                if (!board.is_valid_move(&m))
-                    status = "Invalid move";
-                else
-                {
-                    board.make_move(&m);
-                    status = "Played " + input;
-                }
+                board.make_move(&book_move);
+                status = "Engine played " + move_to_string(book_move) + " (book)";
+                moved = true;
             }
-            catch (const std::exception& e)
+            else
+            {
+                engine_to_move = true;
+                status = "Engine thinking...";
+            }
+        }
+        else if (input.size() == 4 || input.size() == 5)
+        {
+            // e2e4, or e7e8n to underpromote
+            Move m;
+            if (!board.parse_move(input, m))
+                status = "Invalid move";
+            else
             {
-                status = e.what();
+                board.make_move(&m);
+                status = "Played " + input;
+                moved = true;
             }
         }
         else if (input.rfind("fen", 0) == 0)
@@ -212,13 +363,13 @@ int main()
                 if (fen.empty())
                     throw std::runtime_error("Usage: fen <fen-string>");
 
-                board.load_fen(fen);
-
-                eval = engine.eval(&board);
-                best_move = engine.make_move(&board);
-                has_best = true;
+                // A bad FEN leaves the previous position in place
+                ChessBoard loaded;
+                loaded.load_fen(fen);
+                board = loaded;
 
                 status = "FEN loaded";
+                moved = true;
             }
             catch (const std::exception& e)
             {
@@ -228,26 +379,14 @@ int main()
         else
             status = "Unknown command";
 
+        input.clear();
 
-        eval = engine.eval(&board);
-        best_move = engine.make_move(&board);
-        has_best = true;
-
-        if (board.is_checkmate())
-        {
-            status = "Checkmate!";
-            draw_board(board_win, board, eval, has_best ? &best_move : nullptr, turn);
-            draw_command(cmd_win, input, status);
+        if (moved && !position_changed())
             break;
-        }
-        else if (board.is_check(board.turn))
-        {
-            status += " (Check)";
-        }
-
-        input.clear();
     }
 
+    analysis.stop();
+
     delwin(board_win);
     delwin(cmd_win);
     endwin();
@@ -0,0 +1,191 @@
+#include "movepick.hpp"
+
+#include "eval.hpp"
+
+#include <algorithm>
+
+static const int BAD_CAPTURE = -(1 << 20); // pushes losing captures below zero
+
+MovePicker::MovePicker(const ChessBoard* board,
+                       MoveList& moves,
+                       const Move& tt_move,
+                       const Move killers[2],
+                       const Move& counter,
+                       const int (*history)[64])
+    : board(board), moves(moves), tt_move(tt_move), history(history)
+{
+    refutations[0] = killers[0];
+    refutations[1] = killers[1];
+    refutations[2] = counter;
+}
+
+MovePicker::MovePicker(const ChessBoard* board, MoveList& moves)
+    : board(board), moves(moves), stage(Stage::INIT_CAPTURES), captures_only(true), tt_move{}, history(nullptr)
+{
+    refutations[0] = refutations[1] = refutations[2] = Move{};
+}
+
+bool MovePicker::is_noisy(const Move& m) const
+{
+    return m.is_capture() || m.is_promotion();
+}
+
+bool MovePicker::is_refutation(const Move& m) const
+{
+    for (int i = 0; i < refutation_index; i ++)
+    {
+        if (refutations[i] == m)
+            return true;
+    }
+    return false;
+}
+
+// Selection step: swaps the best scored move of [begin, end) to begin
+int MovePicker::pick_best(int begin, int end)
+{
+    int best = begin;
+    for (int i = begin + 1; i < end; i ++)
+    {
+        if (scores[i] > scores[best])
+            best = i;
+    }
+
+    std::swap(moves[begin], moves[best]);
+    std::swap(scores[begin], scores[best]);
+    return begin;
+}
+
+const Move* MovePicker::next()
+{
+    switch (stage)
+    {
+    case Stage::TT_MOVE:
+        stage = Stage::INIT_CAPTURES;
+        if (!tt_move.is_null())
+        {
+            for (int i = 0; i < moves.size(); i ++)
+            {
+                if (moves[i] == tt_move)
+                {
+                    // Parked at the front, every later stage starts behind it
+                    std::swap(moves[0], moves[i]);
+                    current = 1;
+                    return &moves[0];
+                }
+            }
+        }
+        [[fallthrough]];
+
+    case Stage::INIT_CAPTURES:
+    {
+        Move* noisy_end = std::partition(moves.begin() + current, moves.end(),
+                                         [this](const Move& m) { return is_noisy(m); });
+        end_noisy = noisy_end - moves.begin();
+
+        for (int i = current; i < end_noisy; i ++)
+        {
+            const Move& m = moves[i];
+
+            // En passant leaves the target square empty, the victim is a pawn
+            PieceType victim = board->piece_on(m.to()).type;
+            int gain = (victim == PieceType::NONE) ? 0 : PIECE_VALUE[type_index(victim)];
+            if (m.flags() == EP_CAPTURE)
+                gain = PAWN_VALUE;
+            if (m.is_promotion())
+                gain += PIECE_VALUE[type_index(m.promotion_type())] - PAWN_VALUE;
+
+            // MVV-LVA; exchanges are only resolved when the capturer is worth more
+            int attacker = PIECE_VALUE[type_index(board->piece_on(m.from()).type)];
+            scores[i] = gain * 16 - attacker;
+            if (attacker > gain && board->see(m) < 0)
+                scores[i] += BAD_CAPTURE;
+
+            // Underpromotions wait with the losing captures
+            if (m.is_promotion() && m.promotion_type() != PieceType::QUEEN)
+                scores[i] += BAD_CAPTURE;
+        }
+
+        stage = Stage::GOOD_CAPTURES;
+    }
+        [[fallthrough]];
+
+    case Stage::GOOD_CAPTURES:
+        if (current < end_noisy)
+        {
+            int i = pick_best(current, end_noisy);
+            if (scores[i] >= 0)
+            {
+                current ++;
+                return &moves[i];
+            }
+        }
+
+        if (captures_only)
+        {
+            stage = Stage::DONE;
+            return nullptr;
+        }
+
+        // The losing captures wait in [current, end_noisy) until the end
+        bad_begin = current;
+        current = end_noisy;
+        stage = Stage::KILLERS;
+        [[fallthrough]];
+
+    case Stage::KILLERS:
+        while (refutation_index < 3)
+        {
+            const Move& r = refutations[refutation_index];
+            bool repeated = r.is_null() || r == tt_move || is_refutation(r);
+            refutation_index ++;
+            if (repeated)
+                continue;
+
+            // Only quiet moves of this position qualify
+            for (int i = current; i < moves.size(); i ++)
+            {
+                if (moves[i] == r)
+                {
+                    std::swap(moves[current], moves[i]);
+                    return &moves[current ++];
+                }
+            }
+        }
+        stage = Stage::INIT_QUIETS;
+        [[fallthrough]];
+
+    case Stage::INIT_QUIETS:
+        for (int i = current; i < moves.size(); i ++)
+        {
+            scores[i] = history[moves[i].from()][moves[i].to()];
+        }
+        stage = Stage::QUIETS;
+        [[fallthrough]];
+
+    case Stage::QUIETS:
+        if (current < moves.size())
+        {
+            int i = pick_best(current, moves.size());
+            current ++;
+            return &moves[i];
+        }
+        current = bad_begin;
+        stage = Stage::BAD_CAPTURES;
+        [[fallthrough]];
+
+    case Stage::BAD_CAPTURES:
+        if (current < end_noisy)
+        {
+            int i = pick_best(current, end_noisy);
+            current ++;
+            return &moves[i];
+        }
+        stage = Stage::DONE;
+        [[fallthrough]];
+
+    case Stage::DONE:
+        break;
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,248 @@
+#include "nnue.hpp"
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+static std::unique_ptr<NnueNetwork> network;
+const NnueNetwork* NNUE_NET = nullptr;
+
+template <typename T>
+static bool read_values(std::istream& in, T* values, size_t count)
+{
+    if (!in.read(reinterpret_cast<char*>(values), count * sizeof(T)))
+        return false;
+
+    if constexpr (std::endian::native == std::endian::big)
+    {
+        for (size_t i = 0; i < count; i ++)
+            values[i] = std::byteswap(values[i]);
+    }
+    return true;
+}
+
+bool nnue_load(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    char magic[4];
+    uint32_t header[2];
+    if (!in.read(magic, 4) || std::memcmp(magic, "C2NN", 4) != 0 || !read_values(in, header, 2) ||
+        header[0] != NNUE_VERSION || header[1] != NNUE_HIDDEN)
+        return false;
+
+    auto net = std::make_unique<NnueNetwork>();
+    if (!read_values(in, &net->feature_weights[0][0], size_t(NNUE_INPUTS) * NNUE_HIDDEN) ||
+        !read_values(in, net->feature_bias, NNUE_HIDDEN) ||
+        !read_values(in, &net->output_weights[0][0], 2 * NNUE_HIDDEN) ||
+        !read_values(in, &net->output_bias, 1))
+        return false;
+
+    // Trailing bytes mean the file was written for another architecture
+    if (in.peek() != std::ifstream::traits_type::eof())
+        return false;
+
+    network = std::move(net);
+    NNUE_NET = network.get();
+    return true;
+}
+
+void nnue_unload()
+{
+    NNUE_NET = nullptr;
+    network.reset();
+}
+
+// Accumulator rows are added and subtracted a register tile at a time: each
+// tile of the accumulator is loaded once, every changed feature row is
+// applied to it and it is stored once
+#if defined(__AVX2__)
+
+using Vec = __m256i;
+static const int VEC_LANES = 16;
+static inline Vec vec_load(const int16_t* p) { return _mm256_load_si256(reinterpret_cast<const Vec*>(p)); }
+static inline void vec_store(int16_t* p, Vec v) { _mm256_store_si256(reinterpret_cast<Vec*>(p), v); }
+static inline Vec vec_add(Vec a, Vec b) { return _mm256_add_epi16(a, b); }
+static inline Vec vec_sub(Vec a, Vec b) { return _mm256_sub_epi16(a, b); }
+
+#elif defined(__SSE2__)
+
+using Vec = __m128i;
+static const int VEC_LANES = 8;
+static inline Vec vec_load(const int16_t* p) { return _mm_load_si128(reinterpret_cast<const Vec*>(p)); }
+static inline void vec_store(int16_t* p, Vec v) { _mm_store_si128(reinterpret_cast<Vec*>(p), v); }
+static inline Vec vec_add(Vec a, Vec b) { return _mm_add_epi16(a, b); }
+static inline Vec vec_sub(Vec a, Vec b) { return _mm_sub_epi16(a, b); }
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+using Vec = int16x8_t;
+static const int VEC_LANES = 8;
+static inline Vec vec_load(const int16_t* p) { return vld1q_s16(p); }
+static inline void vec_store(int16_t* p, Vec v) { vst1q_s16(p, v); }
+static inline Vec vec_add(Vec a, Vec b) { return vaddq_s16(a, b); }
+static inline Vec vec_sub(Vec a, Vec b) { return vsubq_s16(a, b); }
+
+#else
+#define NNUE_SCALAR
+#endif
+
+#ifndef NNUE_SCALAR
+
+static const int TILE_REGS = 4;
+static const int TILE = VEC_LANES * TILE_REGS;
+static_assert(NNUE_HIDDEN % TILE == 0, "the accumulator is updated in whole tiles");
+
+// The build turns loop unrolling off, the tile has to be unrolled to stay in registers
+void nnue_update(int16_t* acc, const int* added, int add_count, const int* removed, int remove_count)
+{
+    const NnueNetwork& net = *NNUE_NET;
+
+    for (int i = 0; i < NNUE_HIDDEN; i += TILE)
+    {
+        Vec regs[TILE_REGS];
+#pragma GCC unroll 4
+        for (int r = 0; r < TILE_REGS; r ++)
+            regs[r] = vec_load(acc + i + r * VEC_LANES);
+
+        for (int f = 0; f < add_count; f ++)
+        {
+            const int16_t* row = net.feature_weights[added[f]] + i;
+#pragma GCC unroll 4
+            for (int r = 0; r < TILE_REGS; r ++)
+                regs[r] = vec_add(regs[r], vec_load(row + r * VEC_LANES));
+        }
+        for (int f = 0; f < remove_count; f ++)
+        {
+            const int16_t* row = net.feature_weights[removed[f]] + i;
+#pragma GCC unroll 4
+            for (int r = 0; r < TILE_REGS; r ++)
+                regs[r] = vec_sub(regs[r], vec_load(row + r * VEC_LANES));
+        }
+
+#pragma GCC unroll 4
+        for (int r = 0; r < TILE_REGS; r ++)
+            vec_store(acc + i + r * VEC_LANES, regs[r]);
+    }
+}
+
+#else
+
+void nnue_update(int16_t* acc, const int* added, int add_count, const int* removed, int remove_count)
+{
+    const NnueNetwork& net = *NNUE_NET;
+
+    for (int f = 0; f < add_count; f ++)
+    {
+        for (int i = 0; i < NNUE_HIDDEN; i ++)
+            acc[i] += net.feature_weights[added[f]][i];
+    }
+    for (int f = 0; f < remove_count; f ++)
+    {
+        for (int i = 0; i < NNUE_HIDDEN; i ++)
+            acc[i] -= net.feature_weights[removed[f]][i];
+    }
+}
+
+#endif
+
+void nnue_refresh(int16_t* acc, const int* features, int count)
+{
+    std::memcpy(acc, NNUE_NET->feature_bias, sizeof(NNUE_NET->feature_bias));
+    nnue_update(acc, features, count, nullptr, 0);
+}
+
+// Sum of clip(acc, 0, QA) * weight, products are 16 x 16 -> 32 bits
+#if defined(__AVX2__)
+
+static int32_t dot_clipped(const int16_t* acc, const int16_t* weights)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i qa = _mm256_set1_epi16(NNUE_QA);
+    __m256i sum = zero;
+
+    for (int i = 0; i < NNUE_HIDDEN; i += 16)
+    {
+        __m256i v = _mm256_min_epi16(_mm256_max_epi16(vec_load(acc + i), zero), qa);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v, vec_load(weights + i)));
+    }
+
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+
+#elif defined(__SSE2__)
+
+static int32_t dot_clipped(const int16_t* acc, const int16_t* weights)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i qa = _mm_set1_epi16(NNUE_QA);
+    __m128i sum = zero;
+
+    for (int i = 0; i < NNUE_HIDDEN; i += 8)
+    {
+        __m128i v = _mm_min_epi16(_mm_max_epi16(vec_load(acc + i), zero), qa);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(v, vec_load(weights + i)));
+    }
+
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+static int32_t dot_clipped(const int16_t* acc, const int16_t* weights)
+{
+    const int16x8_t zero = vdupq_n_s16(0);
+    const int16x8_t qa = vdupq_n_s16(NNUE_QA);
+    int32x4_t sum = vdupq_n_s32(0);
+
+    for (int i = 0; i < NNUE_HIDDEN; i += 8)
+    {
+        int16x8_t v = vminq_s16(vmaxq_s16(vld1q_s16(acc + i), zero), qa);
+        int16x8_t w = vld1q_s16(weights + i);
+        sum = vmlal_s16(sum, vget_low_s16(v), vget_low_s16(w));
+        sum = vmlal_high_s16(sum, v, w);
+    }
+    return vaddvq_s32(sum);
+}
+
+#else
+
+static int32_t dot_clipped(const int16_t* acc, const int16_t* weights)
+{
+    int32_t sum = 0;
+    for (int i = 0; i < NNUE_HIDDEN; i ++)
+    {
+        int v = acc[i] < 0 ? 0 : acc[i] > NNUE_QA ? NNUE_QA : acc[i];
+        sum += v * weights[i];
+    }
+    return sum;
+}
+
+#endif
+
+int nnue_evaluate(const NnueAccumulator& acc, int side)
+{
+    const NnueNetwork& net = *NNUE_NET;
+
+    int64_t out = net.output_bias
+                + dot_clipped(acc.values[side], net.output_weights[0])
+                + dot_clipped(acc.values[side ^ 1], net.output_weights[1]);
+
+    return int(out * NNUE_SCALE / (NNUE_QA * NNUE_QB));
+}
@@ -0,0 +1,196 @@
+#include "perft.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+struct PerftPosition
+{
+    const char* name;
+    const char* fen;
+    int depth;
+    uint64_t nodes;
+};
+
+// Reference counts from the Chess Programming Wiki "Perft Results" page
+static const PerftPosition PERFT_POSITIONS[] = {
+    { "startpos",  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",                 5, 4865609 },
+    { "kiwipete",  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",     4, 4085603 },
+    { "position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",                                5, 674624  },
+    { "position4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",         4, 422333  },
+    { "position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",                4, 2103487 },
+    { "position6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594 },
+};
+
+static int64_t elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t perft(ChessBoard& board, int depth)
+{
+    MoveList moves;
+    board.get_legal_moves(moves);
+
+    if (depth <= 1)
+        return depth == 1 ? moves.size() : 1;
+
+    uint64_t nodes = 0;
+    for (auto& m : moves)
+    {
+        board.make_move(&m);
+        nodes += perft(board, depth - 1);
+        board.undo_move();
+    }
+    return nodes;
+}
+
+uint64_t perft(const Position& position, int depth)
+{
+    MoveList moves;
+    position.get_legal_moves(moves);
+
+    if (depth <= 1)
+        return depth == 1 ? moves.size() : 1;
+
+    uint64_t nodes = 0;
+    for (auto& m : moves)
+    {
+        Position next = position;
+        next.make_move(m);
+        nodes += perft(next, depth - 1);
+    }
+    return nodes;
+}
+
+// Counts the subtree below every root move, the root moves are handed out to
+// the workers one at a time and each worker plays them on its own board copy
+static void split_root(const ChessBoard& position, const MoveList& moves, int depth, int threads, std::vector<uint64_t>& counts)
+{
+    counts.assign(moves.size(), 1);
+    std::atomic<int> next = 0;
+
+    auto work = [&]()
+    {
+        ChessBoard board = position;
+        for (int i = next++; i < moves.size(); i = next++)
+        {
+            board.make_move(&moves.moves[i]);
+            counts[i] = perft(board, depth - 1);
+            board.undo_move();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < std::max(1, threads); i ++)
+        workers.emplace_back(work);
+    work();
+    for (auto& w : workers)
+        w.join();
+}
+
+static void print_summary(std::ostream& out, uint64_t nodes, int64_t ms)
+{
+    out << "\nNodes: " << nodes << "\nTime:  " << ms << " ms\nNPS:   "
+        << (ms ? nodes * 1000 / ms : 0) << std::endl;
+}
+
+uint64_t perft_divide(const ChessBoard& position, int depth, int threads, std::ostream& out)
+{
+    ChessBoard root = position;
+    MoveList moves;
+    root.get_legal_moves(moves);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint64_t> counts;
+    split_root(position, moves, std::max(1, depth), threads, counts);
+    int64_t ms = elapsed_ms(start);
+
+    uint64_t total = 0;
+    for (int i = 0; i < moves.size(); i ++)
+    {
+        out << move_to_string(moves.moves[i]) << ": " << counts[i] << "\n";
+        total += counts[i];
+    }
+
+    print_summary(out, total, ms);
+    return total;
+}
+
+bool perft_suite(int threads, std::ostream& out)
+{
+    bool passed = true;
+    uint64_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& pos : PERFT_POSITIONS)
+    {
+        ChessBoard board;
+        board.load_fen(pos.fen);
+
+        MoveList moves;
+        board.get_legal_moves(moves);
+
+        auto t = std::chrono::steady_clock::now();
+        std::vector<uint64_t> counts;
+        split_root(board, moves, pos.depth, threads, counts);
+
+        uint64_t nodes = 0;
+        for (auto c : counts)
+            nodes += c;
+        total += nodes;
+
+        bool ok = nodes == pos.nodes;
+        passed &= ok;
+
+        out << (ok ? "PASS " : "FAIL ") << pos.name << " depth " << pos.depth
+            << ": " << nodes << " (expected " << pos.nodes << ") "
+            << elapsed_ms(t) << " ms" << std::endl;
+    }
+
+    print_summary(out, total, elapsed_ms(start));
+    return passed;
+}
+
+bool perft_compare(int extra_depth, std::ostream& out)
+{
+    bool passed = true;
+    int64_t make_ms = 0, copy_ms = 0;
+    uint64_t total = 0;
+
+    for (auto& pos : PERFT_POSITIONS)
+    {
+        ChessBoard board;
+        board.load_fen(pos.fen);
+        int depth = pos.depth + std::max(0, extra_depth);
+
+        auto t = std::chrono::steady_clock::now();
+        uint64_t make_nodes = perft(board, depth);
+        int64_t make_time = elapsed_ms(t);
+
+        t = std::chrono::steady_clock::now();
+        uint64_t copy_nodes = perft(Position(board), depth);
+        int64_t copy_time = elapsed_ms(t);
+
+        // Only the suite depth has a known count
+        bool ok = make_nodes == copy_nodes && (extra_depth > 0 || make_nodes == pos.nodes);
+        passed &= ok;
+        make_ms += make_time;
+        copy_ms += copy_time;
+        total += make_nodes;
+
+        out << (ok ? "PASS " : "FAIL ") << pos.name << " depth " << depth
+            << ": make/unmake " << make_nodes << " " << make_time << " ms, copy-make "
+            << copy_nodes << " " << copy_time << " ms" << std::endl;
+    }
+
+    out << "\nNodes:        " << total
+        << "\nMake/unmake:  " << make_ms << " ms, " << (make_ms ? total * 1000 / make_ms : 0) << " nps"
+        << "\nCopy-make:    " << copy_ms << " ms, " << (copy_ms ? total * 1000 / copy_ms : 0) << " nps"
+        << "\nPosition:     " << sizeof(Position) << " bytes, ChessBoard " << sizeof(ChessBoard) << " bytes"
+        << std::endl;
+    return passed;
+}
@@ -0,0 +1,166 @@
+#include "position.hpp"
+
+#include "movegen.hpp"
+
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<Position>, "positions are copied as plain memory");
+static_assert(sizeof(Position) <= 160, "a position should stay within a few cache lines");
+
+static const int PAWN   = type_index(PieceType::PAWN);
+static const int KNIGHT = type_index(PieceType::KNIGHT);
+static const int BISHOP = type_index(PieceType::BISHOP);
+static const int ROOK   = type_index(PieceType::ROOK);
+static const int QUEEN  = type_index(PieceType::QUEEN);
+static const int KING   = type_index(PieceType::KING);
+
+// Castling rights kept when a move leaves or lands on a square
+struct CastlingMasks
+{
+    uint8_t mask[64];
+};
+
+static constexpr CastlingMasks make_castling_masks()
+{
+    CastlingMasks m{};
+    for (int sq = 0; sq < 64; sq ++)
+        m.mask[sq] = WHITE_OO | WHITE_OOO | BLACK_OO | BLACK_OOO;
+
+    m.mask[0]  &= ~WHITE_OOO;              // a1
+    m.mask[4]  &= ~(WHITE_OO | WHITE_OOO); // e1
+    m.mask[7]  &= ~WHITE_OO;               // h1
+    m.mask[56] &= ~BLACK_OOO;              // a8
+    m.mask[60] &= ~(BLACK_OO | BLACK_OOO); // e8
+    m.mask[63] &= ~BLACK_OO;               // h8
+    return m;
+}
+
+static constexpr CastlingMasks CASTLING_MASKS = make_castling_masks();
+
+Position::Position(const ChessBoard& board)
+{
+    for (int c = 0; c < 2; c ++)
+    {
+        for (int t = 0; t < 6; t ++)
+            pieces[c][t] = board.pieces[c][t];
+        occupancy[c] = board.occupancy[c];
+        king_square[c] = board.king_square[c];
+
+        if (king_square[c] == NO_SQUARE)
+            throw std::invalid_argument("Position needs both kings");
+    }
+
+    occupied  = board.occupied;
+    hash      = board.hash;
+    psq_score = board.psq_score;
+    side      = color_index(board.turn);
+    castling  = board.castling_rights();
+    ep_square = board.ep_square;
+}
+
+int Position::type_on(int color, int sq) const
+{
+    for (int t = 0; t < 6; t ++)
+    {
+        if (pieces[color][t] & square_bb(sq))
+            return t;
+    }
+    return -1;
+}
+
+void Position::put_piece(int color, int type, int sq)
+{
+    Bitboard b = square_bb(sq);
+    pieces[color][type] |= b;
+    occupancy[color] |= b;
+    occupied |= b;
+    hash ^= ZOBRIST.pieces[color][type][sq];
+    psq_score += PSQT.value[color][type][sq];
+}
+
+void Position::remove_piece(int color, int type, int sq)
+{
+    Bitboard b = ~square_bb(sq);
+    pieces[color][type] &= b;
+    occupancy[color] &= b;
+    occupied &= b;
+    hash ^= ZOBRIST.pieces[color][type][sq];
+    psq_score -= PSQT.value[color][type][sq];
+}
+
+void Position::make_move(const Move& m)
+{
+    int us = side;
+    int them = us ^ 1;
+    int from = m.from();
+    int to = m.to();
+    int flags = m.flags();
+    int moved = type_on(us, from);
+
+    // Rights and en passant are re-hashed once they are final
+    hash ^= ZOBRIST.castling[castling];
+    if (ep_square != NO_SQUARE)
+        hash ^= ZOBRIST.ep_file[square_x(ep_square)];
+    ep_square = NO_SQUARE;
+
+    if (flags == EP_CAPTURE)
+        remove_piece(them, PAWN, make_square(square_x(to), square_y(from)));
+    else if (m.is_capture())
+        remove_piece(them, type_on(them, to), to);
+
+    remove_piece(us, moved, from);
+    put_piece(us, m.is_promotion() ? type_index(m.promotion_type()) : moved, to);
+
+    if (moved == KING)
+        king_square[us] = to;
+
+    // Castling moves the rook as well
+    if (m.is_castle())
+    {
+        int rank = square_y(from);
+        remove_piece(us, ROOK, make_square(flags == KING_CASTLE ? 7 : 0, rank));
+        put_piece(us, ROOK, make_square(flags == KING_CASTLE ? 5 : 3, rank));
+    }
+
+    // A double push allows en passant when an enemy pawn can take
+    if (flags == DOUBLE_PUSH)
+    {
+        int passed = (from + to) / 2;
+        if (PAWN_ATTACKS[us][passed] & pieces[them][PAWN])
+            ep_square = passed;
+    }
+
+    castling &= CASTLING_MASKS.mask[from] & CASTLING_MASKS.mask[to];
+    hash ^= ZOBRIST.castling[castling];
+    if (ep_square != NO_SQUARE)
+        hash ^= ZOBRIST.ep_file[square_x(ep_square)];
+
+    side = them;
+    hash ^= ZOBRIST.side;
+}
+
+Bitboard Position::attackers_to(int sq, Bitboard occ) const
+{
+    const Bitboard (&p)[2][6] = pieces;
+
+    Bitboard diagonal = p[0][BISHOP] | p[1][BISHOP] | p[0][QUEEN] | p[1][QUEEN];
+    Bitboard straight = p[0][ROOK]   | p[1][ROOK]   | p[0][QUEEN] | p[1][QUEEN];
+
+    return (PAWN_ATTACKS[1][sq] & p[0][PAWN]) |
+           (PAWN_ATTACKS[0][sq] & p[1][PAWN]) |
+           (KNIGHT_ATTACKS[sq] & (p[0][KNIGHT] | p[1][KNIGHT])) |
+           (KING_ATTACKS[sq] & (p[0][KING] | p[1][KING])) |
+           (bishop_attacks(sq, occ) & diagonal) |
+           (rook_attacks(sq, occ) & straight);
+}
+
+bool Position::in_check() const
+{
+    return attackers_to(king_square[side], occupied) & occupancy[side ^ 1];
+}
+
+void Position::get_legal_moves(MoveList& moves) const
+{
+    Bitboard checkers = attackers_to(king_square[side], occupied) & occupancy[side ^ 1];
+    generate_legal_moves(*this, side, castling, checkers, moves);
+}
@@ -0,0 +1,1052 @@
+#include "syzygy.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The file layout and index scheme follow Ronald de Man's Syzygy generator
+
+static const int TB_PIECES  = 7;
+static const int TB_MAX_DTZ = 1 << 18; // root move ranks stay within this
+
+static const int PAWN = type_index(PieceType::PAWN);
+static const int KING = type_index(PieceType::KING);
+
+static const uint8_t WDL_MAGIC[4] = { 0x71, 0xE8, 0x23, 0x5D };
+static const uint8_t DTZ_MAGIC[4] = { 0xD7, 0x66, 0x0C, 0xA5 };
+
+// Table header flags
+static const uint8_t HEADER_SPLIT     = 1; // both sides to move are stored
+static const uint8_t HEADER_HAS_PAWNS = 2;
+
+// Flags of one compressed table
+static const uint8_t PAIRS_STM          = 1;   // DTZ: the side to move stored
+static const uint8_t PAIRS_MAPPED       = 2;   // DTZ: values go through a map
+static const uint8_t PAIRS_WIN_PLIES    = 4;   // DTZ: wins are in plies, not moves
+static const uint8_t PAIRS_LOSS_PLIES   = 8;
+static const uint8_t PAIRS_WIDE         = 16;  // DTZ: 16-bit map
+static const uint8_t PAIRS_SINGLE_VALUE = 128; // every position has the same value
+
+// Tables are little-endian except for the Huffman coded blocks
+static inline uint32_t read_le(const uint8_t* p, int bytes)
+{
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; i --)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static inline uint32_t read_be32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+// Squares below the a1-h8 diagonal are negative
+static constexpr int off_diagonal(int sq)
+{
+    return (sq >> 3) - (sq & 7);
+}
+
+struct IndexTables
+{
+    uint64_t binomial[TB_PIECES][64];   // [k][n] ways to choose k of n squares
+    int map_pawns[64];                  // a2-h7 to 0..47, the leading pawn has the highest
+    int lead_pawn_idx[6][64];           // [leading pawns][square of the first]
+    int lead_pawns_size[6][4];          // [leading pawns][file a-d]
+    int map_b1h1h7[64];                 // squares below the diagonal to 0..27
+    int map_a1d1d4[64];                 // a1-d1-d4 triangle to 0..9, diagonal last
+    int kk_idx[10][64];                 // both kings to 0..461
+};
+
+static constexpr IndexTables make_index_tables()
+{
+    IndexTables t{};
+
+    t.binomial[0][0] = 1;
+    for (int n = 1; n < 64; n ++)
+    {
+        for (int k = 0; k < TB_PIECES && k <= n; k ++)
+            t.binomial[k][n] = (k > 0 ? t.binomial[k - 1][n - 1] : 0) + (k < n ? t.binomial[k][n - 1] : 0);
+    }
+
+    int code = 0;
+    for (int sq = 0; sq < 64; sq ++)
+    {
+        if (off_diagonal(sq) < 0)
+            t.map_b1h1h7[sq] = code ++;
+    }
+
+    code = 0;
+    int diagonal[4]{}, diagonal_count = 0;
+    for (int sq = 0; sq <= 27; sq ++)
+    {
+        if ((sq & 7) > 3)
+            continue;
+        if (off_diagonal(sq) < 0)
+            t.map_a1d1d4[sq] = code ++;
+        else if (off_diagonal(sq) == 0)
+            diagonal[diagonal_count ++] = sq;
+    }
+    for (int i = 0; i < diagonal_count; i ++)
+        t.map_a1d1d4[diagonal[i]] = code ++;
+
+    // Kings both on the diagonal come last
+    code = 0;
+    int both_idx[64]{}, both_sq[64]{}, both_count = 0;
+    for (int idx = 0; idx < 10; idx ++)
+    {
+        for (int s1 = 0; s1 <= 27; s1 ++)
+        {
+            // Squares outside the triangle also read 0, only b1 has code 0
+            if (t.map_a1d1d4[s1] != idx || (idx == 0 && s1 != 1))
+                continue;
+
+            for (int s2 = 0; s2 < 64; s2 ++)
+            {
+                int dx = (s1 & 7) - (s2 & 7), dy = (s1 >> 3) - (s2 >> 3);
+                if (dx >= -1 && dx <= 1 && dy >= -1 && dy <= 1)
+                    continue; // touching kings
+
+                if (off_diagonal(s1) == 0 && off_diagonal(s2) > 0)
+                    continue; // mirrored below the diagonal
+
+                if (off_diagonal(s1) == 0 && off_diagonal(s2) == 0)
+                {
+                    both_idx[both_count] = idx;
+                    both_sq[both_count ++] = s2;
+                }
+                else
+                    t.kk_idx[idx][s2] = code ++;
+            }
+        }
+    }
+    for (int i = 0; i < both_count; i ++)
+        t.kk_idx[both_idx[i]][both_sq[i]] = code ++;
+
+    // The leading pawn is the one nearest the a/h edge, then the lowest
+    int available = 47;
+    for (int count = 1; count <= 5; count ++)
+    {
+        for (int file = 0; file < 4; file ++)
+        {
+            int idx = 0;
+            for (int rank = 1; rank <= 6; rank ++)
+            {
+                int sq = rank * 8 + file;
+                if (count == 1)
+                {
+                    t.map_pawns[sq] = available --;
+                    t.map_pawns[sq ^ 7] = available --;
+                }
+                t.lead_pawn_idx[count][sq] = idx;
+                idx += t.binomial[count - 1][t.map_pawns[sq]];
+            }
+            t.lead_pawns_size[count][file] = idx;
+        }
+    }
+
+    return t;
+}
+
+static constexpr IndexTables INDEX = make_index_tables();
+
+static bool pawns_less(int a, int b)
+{
+    return INDEX.map_pawns[a] < INDEX.map_pawns[b];
+}
+
+// One compressed table: a side to move and, with pawns, a file of the leading pawn
+struct Tablebases::PairsData
+{
+    uint8_t flags = 0;
+    uint64_t block_size = 0;        // bytes of a compressed block
+    uint64_t span = 0;              // values between sparse index entries
+    uint64_t sparse_index_size = 0;
+    uint64_t block_length_size = 0;
+    uint32_t blocks_num = 0;
+    int min_sym_len = 0;            // the value itself for a single valued table
+
+    const uint8_t* lowest_sym = nullptr;   // 16-bit, first symbol of each code length
+    const uint8_t* btree = nullptr;        // 24-bit pairs of child symbols
+    const uint8_t* sparse_index = nullptr; // 32-bit block and 16-bit offset
+    const uint8_t* block_length = nullptr; // 16-bit, values in a block minus one
+    const uint8_t* data = nullptr;
+
+    std::vector<uint64_t> base64; // lowest code of each length, left aligned
+    std::vector<uint8_t> symlen;  // values a symbol expands to, minus one
+
+    uint8_t pieces[TB_PIECES]{};          // order of encoding, 8 * colour + piece type
+    int group_len[TB_PIECES + 1]{};       // zero terminated
+    uint64_t group_idx[TB_PIECES + 1]{};  // multiplier of each group, the last is the table size
+    uint16_t map_idx[4]{};                // DTZ map start per result
+};
+
+struct Tablebases::TableFile
+{
+    std::string path;
+    std::atomic<bool> ready{false};
+    const uint8_t* base = nullptr; // null when missing or corrupt
+    size_t size = 0;
+    int sides = 1;
+    const uint8_t* dtz_map = nullptr;
+    PairsData pairs[2][4]; // [side][file], file a only without pawns
+};
+
+struct Tablebases::Table
+{
+    uint64_t key = 0;  // material of the name, left side white
+    uint64_t key2 = 0; // colours swapped
+    int piece_count = 0;
+    bool has_pawns = false;
+    bool has_unique_pieces = false; // a piece other than a king without a twin
+    int pawn_count[2]{};            // leading colour first
+    TableFile wdl, dtz;
+};
+
+static uint64_t material_key(const int counts[2][6])
+{
+    uint64_t key = 0;
+    for (int c = 0; c < 2; c ++)
+    {
+        for (int t = 0; t < 6; t ++)
+            key |= uint64_t(counts[c][t]) << (4 * (6 * c + t));
+    }
+    return key;
+}
+
+static uint64_t material_key(const Position& pos)
+{
+    int counts[2][6];
+    for (int c = 0; c < 2; c ++)
+    {
+        for (int t = 0; t < 6; t ++)
+            counts[c][t] = popcount(pos.pieces[c][t]);
+    }
+    return material_key(counts);
+}
+
+// "KRPvKR" into piece counts, false for anything that is not a table name
+static bool parse_name(const std::string& name, int counts[2][6])
+{
+    static const char LETTERS[] = "PNBRQK";
+
+    int side = 0, total = 0;
+    for (int c = 0; c < 2; c ++)
+        std::fill(counts[c], counts[c] + 6, 0);
+
+    for (char ch : name)
+    {
+        if (ch == 'v' && side == 0)
+        {
+            side = 1;
+            continue;
+        }
+
+        const char* p = std::find(LETTERS, LETTERS + 6, ch);
+        if (p == LETTERS + 6)
+            return false;
+        counts[side][p - LETTERS] ++;
+        total ++;
+    }
+
+    return side == 1 && counts[0][KING] == 1 && counts[1][KING] == 1 && total <= TB_PIECES;
+}
+
+// The recursive pairing tree is acyclic, every symbol is expanded once
+static int set_symlen(Tablebases::PairsData& d, int sym, std::vector<bool>& visited);
+
+// Groups of equal pieces and the multiplier each group gets in the index
+static void set_groups(Tablebases::PairsData& d, const int order[2], int file,
+                       int piece_count, bool has_pawns, bool has_unique_pieces, bool both_pawns)
+{
+    int n = 0;
+    int first_len = has_pawns ? 0 : has_unique_pieces ? 3 : 2;
+    d.group_len[n] = 1;
+
+    for (int i = 1; i < piece_count; i ++)
+    {
+        if (--first_len > 0 || d.pieces[i] != d.pieces[i - 1])
+            d.group_len[++n] = 1;
+        else
+            d.group_len[n] ++;
+    }
+    d.group_len[++n] = 0;
+
+    // The groups are stored in a per-table order: the leading group at
+    // order[0], the other side's pawns at order[1] and then the rest
+    int next = both_pawns ? 2 : 1;
+    int free_squares = 64 - d.group_len[0] - (both_pawns ? d.group_len[1] : 0);
+    uint64_t idx = 1;
+
+    for (int k = 0; next < n || k == order[0] || k == order[1]; k ++)
+    {
+        if (k == order[0])
+        {
+            d.group_idx[0] = idx;
+            idx *= has_pawns ? INDEX.lead_pawns_size[d.group_len[0]][file]
+                 : has_unique_pieces ? 31332 : 462;
+        }
+        else if (k == order[1])
+        {
+            d.group_idx[1] = idx;
+            idx *= INDEX.binomial[d.group_len[1]][48 - d.group_len[0]];
+        }
+        else
+        {
+            d.group_idx[next] = idx;
+            idx *= INDEX.binomial[d.group_len[next]][free_squares];
+            free_squares -= d.group_len[next ++];
+        }
+    }
+    d.group_idx[n] = idx;
+}
+
+static int set_symlen(Tablebases::PairsData& d, int sym, std::vector<bool>& visited)
+{
+    visited[sym] = true;
+
+    const uint8_t* lr = d.btree + 3 * sym;
+    int right = (lr[2] << 4) | (lr[1] >> 4);
+    if (right == 0xFFF)
+        return 0;
+    int left = ((lr[1] & 0xF) << 8) | lr[0];
+
+    if (!visited[left])
+        d.symlen[left] = set_symlen(d, left, visited);
+    if (!visited[right])
+        d.symlen[right] = set_symlen(d, right, visited);
+
+    return d.symlen[left] + d.symlen[right] + 1;
+}
+
+// Huffman code lengths, the symbol tree and block geometry
+static const uint8_t* set_sizes(Tablebases::PairsData& d, const uint8_t* data)
+{
+    d.flags = *data++;
+
+    if (d.flags & PAIRS_SINGLE_VALUE)
+    {
+        d.min_sym_len = *data++;
+        return data;
+    }
+
+    uint64_t tb_size = d.group_idx[std::find(d.group_len, d.group_len + TB_PIECES, 0) - d.group_len];
+
+    d.block_size = 1ULL << *data++;
+    d.span = 1ULL << *data++;
+    d.sparse_index_size = (tb_size + d.span - 1) / d.span;
+    int padding = *data++;
+    d.blocks_num = read_le(data, 4);
+    data += 4;
+    d.block_length_size = d.blocks_num + padding; // keeps the sparse index in range
+
+    int max_sym_len = *data++;
+    d.min_sym_len = *data++;
+    d.lowest_sym = data;
+    d.base64.assign(max_sym_len - d.min_sym_len + 1, 0);
+
+    // Canonical Huffman: longer codes have lower values, so a code padded
+    // to 64 bits is found by walking down base64 until it is not below
+    for (int i = int(d.base64.size()) - 2; i >= 0; i --)
+    {
+        d.base64[i] = (d.base64[i + 1] + read_le(d.lowest_sym + 2 * i, 2)
+                       - read_le(d.lowest_sym + 2 * (i + 1), 2)) / 2;
+    }
+    for (size_t i = 0; i < d.base64.size(); i ++)
+        d.base64[i] <<= 64 - i - d.min_sym_len;
+
+    data += d.base64.size() * 2;
+    d.symlen.assign(read_le(data, 2), 0);
+    data += 2;
+    d.btree = data;
+
+    std::vector<bool> visited(d.symlen.size());
+    for (size_t sym = 0; sym < d.symlen.size(); sym ++)
+    {
+        if (!visited[sym])
+            d.symlen[sym] = set_symlen(d, sym, visited);
+    }
+
+    return data + d.symlen.size() * 3 + (d.symlen.size() & 1);
+}
+
+// Value number `idx` of a compressed table
+static int decompress_pairs(const Tablebases::PairsData& d, uint64_t idx)
+{
+    if (d.flags & PAIRS_SINGLE_VALUE)
+        return d.min_sym_len;
+
+    // Sparse index entry k points at value k * span + span / 2, walk the
+    // block lengths from there to the block holding idx
+    uint32_t k = uint32_t(idx / d.span);
+    const uint8_t* entry = d.sparse_index + 6 * uint64_t(k);
+    uint32_t block = read_le(entry, 4);
+    int64_t offset = read_le(entry + 4, 2);
+    offset += int64_t(idx % d.span) - int64_t(d.span / 2);
+
+    while (offset < 0)
+        offset += read_le(d.block_length + 2 * uint64_t(--block), 2) + 1;
+    while (offset > read_le(d.block_length + 2 * uint64_t(block), 2))
+        offset -= read_le(d.block_length + 2 * uint64_t(block ++), 2) + 1;
+
+    const uint8_t* ptr = d.data + uint64_t(block) * d.block_size;
+    uint64_t buf64 = (uint64_t(read_be32(ptr)) << 32) | read_be32(ptr + 4);
+    ptr += 8;
+    int buf64_size = 64;
+    int sym;
+
+    // Every symbol stands for symlen + 1 values, skip whole symbols first
+    while (true)
+    {
+        int len = 0;
+        while (buf64 < d.base64[len])
+            len ++;
+
+        sym = int((buf64 - d.base64[len]) >> (64 - len - d.min_sym_len));
+        sym += read_le(d.lowest_sym + 2 * len, 2);
+
+        if (offset < d.symlen[sym] + 1)
+            break;
+
+        offset -= d.symlen[sym] + 1;
+        len += d.min_sym_len;
+        buf64 <<= len;
+        buf64_size -= len;
+
+        if (buf64_size <= 32)
+        {
+            buf64_size += 32;
+            buf64 |= uint64_t(read_be32(ptr)) << (64 - buf64_size);
+            ptr += 4;
+        }
+    }
+
+    // Then descend the pair tree to the single value
+    while (d.symlen[sym])
+    {
+        const uint8_t* lr = d.btree + 3 * sym;
+        int left = ((lr[1] & 0xF) << 8) | lr[0];
+
+        if (offset < d.symlen[left] + 1)
+            sym = left;
+        else
+        {
+            offset -= d.symlen[left] + 1;
+            sym = (lr[2] << 4) | (lr[1] >> 4);
+        }
+    }
+
+    const uint8_t* lr = d.btree + 3 * sym;
+    return ((lr[1] & 0xF) << 8) | lr[0];
+}
+
+// Sets up the compressed tables of a freshly mapped file, false if it does not fit the name
+static bool init_file(Tablebases::TableFile& f, const Tablebases::Table& e, bool dtz)
+{
+    const uint8_t* base = f.base;
+    const uint8_t* data = base + 4;
+
+    bool split = e.key != e.key2 && !dtz;
+    if (bool(*data & HEADER_HAS_PAWNS) != e.has_pawns || (!dtz && bool(*data & HEADER_SPLIT) != split))
+        return false;
+    data ++;
+
+    f.sides = split ? 2 : 1;
+    int max_file = e.has_pawns ? 3 : 0;
+    bool both_pawns = e.has_pawns && e.pawn_count[1];
+
+    for (int file = 0; file <= max_file; file ++)
+    {
+        int order[2][2] = {
+            { data[0] & 0xF, both_pawns ? data[1] & 0xF : 0xF },
+            { data[0] >> 4,  both_pawns ? data[1] >> 4  : 0xF }
+        };
+        data += 1 + both_pawns;
+
+        for (int k = 0; k < e.piece_count; k ++, data ++)
+        {
+            for (int i = 0; i < f.sides; i ++)
+                f.pairs[i][file].pieces[k] = i ? *data >> 4 : *data & 0xF;
+        }
+
+        for (int i = 0; i < f.sides; i ++)
+            set_groups(f.pairs[i][file], order[i], file, e.piece_count, e.has_pawns, e.has_unique_pieces, both_pawns);
+    }
+
+    data += (data - base) & 1;
+
+    for (int file = 0; file <= max_file; file ++)
+    {
+        for (int i = 0; i < f.sides; i ++)
+            data = set_sizes(f.pairs[i][file], data);
+    }
+
+    // DTZ values of each result may go through a byte or word map
+    if (dtz)
+    {
+        f.dtz_map = data;
+        for (int file = 0; file <= max_file; file ++)
+        {
+            Tablebases::PairsData& d = f.pairs[0][file];
+            if (!(d.flags & PAIRS_MAPPED))
+                continue;
+
+            if (d.flags & PAIRS_WIDE)
+            {
+                data += (data - base) & 1;
+                for (int i = 0; i < 4; i ++)
+                {
+                    d.map_idx[i] = uint16_t((data - f.dtz_map) / 2 + 1);
+                    data += 2 * read_le(data, 2) + 2;
+                }
+            }
+            else
+            {
+                for (int i = 0; i < 4; i ++)
+                {
+                    d.map_idx[i] = uint16_t(data - f.dtz_map + 1);
+                    data += *data + 1;
+                }
+            }
+        }
+        data += (data - base) & 1;
+    }
+
+    for (int file = 0; file <= max_file; file ++)
+    {
+        for (int i = 0; i < f.sides; i ++)
+        {
+            f.pairs[i][file].sparse_index = data;
+            data += f.pairs[i][file].sparse_index_size * 6;
+        }
+    }
+
+    for (int file = 0; file <= max_file; file ++)
+    {
+        for (int i = 0; i < f.sides; i ++)
+        {
+            f.pairs[i][file].block_length = data;
+            data += f.pairs[i][file].block_length_size * 2;
+        }
+    }
+
+    for (int file = 0; file <= max_file; file ++)
+    {
+        for (int i = 0; i < f.sides; i ++)
+        {
+            data += (64 - (data - base) % 64) % 64;
+            f.pairs[i][file].data = data;
+            data += uint64_t(f.pairs[i][file].blocks_num) * f.pairs[i][file].block_size;
+        }
+    }
+
+    return data <= base + f.size;
+}
+
+Tablebases::Tablebases()
+{}
+
+Tablebases::~Tablebases()
+{
+    clear();
+}
+
+void Tablebases::clear()
+{
+    for (auto& t : tables)
+    {
+        for (TableFile* f : { &t->wdl, &t->dtz })
+        {
+            if (f->base)
+                munmap(const_cast<uint8_t*>(f->base), f->size);
+        }
+    }
+
+    tables.clear();
+    by_material.clear();
+    max_pieces = 0;
+}
+
+void Tablebases::init(const std::string& paths)
+{
+    namespace fs = std::filesystem;
+
+    clear();
+    if (paths.empty() || paths == "<empty>")
+        return;
+
+    std::istringstream in(paths);
+    std::string dir;
+    while (std::getline(in, dir, ':'))
+    {
+        std::error_code ec;
+        for (auto& item : fs::directory_iterator(dir, ec))
+        {
+            fs::path path = item.path();
+            if (path.extension() != ".rtbw")
+                continue;
+
+            int counts[2][6];
+            if (!parse_name(path.stem().string(), counts))
+                continue;
+
+            // The first directory that has a table wins
+            uint64_t key = material_key(counts);
+            if (by_material.count(key))
+                continue;
+
+            auto t = std::make_unique<Table>();
+            t->key = key;
+            std::swap(counts[0], counts[1]);
+            t->key2 = material_key(counts);
+            std::swap(counts[0], counts[1]);
+
+            for (int c = 0; c < 2; c ++)
+            {
+                for (int p = 0; p < 6; p ++)
+                {
+                    t->piece_count += counts[c][p];
+                    if (p != KING && counts[c][p] == 1)
+                        t->has_unique_pieces = true;
+                }
+            }
+
+            // With pawns on both sides the side with fewer leads, white on a tie
+            int white = counts[0][PAWN], black = counts[1][PAWN];
+            t->has_pawns = white || black;
+            bool white_leads = !black || (white && black >= white);
+            t->pawn_count[0] = white_leads ? white : black;
+            t->pawn_count[1] = white_leads ? black : white;
+
+            t->wdl.path = path.string();
+            t->dtz.path = fs::path(path).replace_extension(".rtbz").string();
+
+            by_material[t->key] = t.get();
+            by_material[t->key2] = t.get();
+            max_pieces = std::max(max_pieces, t->piece_count);
+            tables.push_back(std::move(t));
+        }
+    }
+}
+
+Tablebases::Table* Tablebases::find(const Position& pos) const
+{
+    auto it = by_material.find(material_key(pos));
+    return it == by_material.end() ? nullptr : it->second;
+}
+
+// Maps a file on first use; a file that is missing or fails the checks stays unmapped
+bool Tablebases::map(TableFile& f, const Table& table, bool dtz)
+{
+    if (f.ready.load(std::memory_order_acquire))
+        return f.base != nullptr;
+
+    std::lock_guard<std::mutex> guard(map_lock);
+    if (f.ready.load(std::memory_order_relaxed))
+        return f.base != nullptr;
+
+    int fd = ::open(f.path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        // Table files are a multiple of 64 bytes plus a 16 byte trailer
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size % 64 == 16)
+        {
+            void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (m != MAP_FAILED)
+            {
+                madvise(m, st.st_size, MADV_RANDOM);
+                f.base = static_cast<const uint8_t*>(m);
+                f.size = st.st_size;
+            }
+        }
+        ::close(fd);
+    }
+
+    if (f.base && (!std::equal(f.base, f.base + 4, dtz ? DTZ_MAGIC : WDL_MAGIC) || !init_file(f, table, dtz)))
+    {
+        munmap(const_cast<uint8_t*>(f.base), f.size);
+        f.base = nullptr;
+    }
+
+    f.ready.store(true, std::memory_order_release);
+    return f.base != nullptr;
+}
+
+// DTZ in plies from the stored value, for a position known to be won or lost
+static int map_dtz(const Tablebases::TableFile& f, const Tablebases::PairsData& d, int value, int wdl)
+{
+    static const int WDL_MAP[] = { 1, 3, 0, 2, 0 };
+
+    if (d.flags & PAIRS_MAPPED)
+    {
+        int i = d.map_idx[WDL_MAP[wdl + 2]] + value;
+        value = (d.flags & PAIRS_WIDE) ? read_le(f.dtz_map + 2 * i, 2) : f.dtz_map[i];
+    }
+
+    if ((wdl == WDL_WIN && !(d.flags & PAIRS_WIN_PLIES)) ||
+        (wdl == WDL_LOSS && !(d.flags & PAIRS_LOSS_PLIES)) ||
+        wdl == WDL_CURSED_WIN || wdl == WDL_BLESSED_LOSS)
+        value *= 2;
+
+    return value + 1;
+}
+
+// The stored value of a position: WDL score, or DTZ for the known result `wdl`
+int Tablebases::probe_table(const Position& pos, bool dtz, int wdl, ProbeState& state)
+{
+    if (popcount(pos.occupied) == 2)
+        return 0; // bare kings
+
+    Table* e = find(pos);
+    TableFile* f = e ? (dtz ? &e->dtz : &e->wdl) : nullptr;
+    if (!f || !map(*f, *e, dtz))
+    {
+        state = PROBE_FAIL;
+        return 0;
+    }
+
+    // Tables are stored with the stronger side (the name's left) as white;
+    // symmetric ones only with white to move
+    bool flip = (e->key == e->key2 && pos.side == 1) || material_key(pos) != e->key;
+    int flip_color = flip ? 8 : 0;
+    int flip_squares = flip ? 56 : 0;
+    int stm = flip ^ pos.side;
+
+    int squares[TB_PIECES], pieces[TB_PIECES];
+    int size = 0, lead_count = 0, file = 0;
+    Bitboard lead_pawns = 0;
+
+    // Pawns of the leading colour come first, the one with the highest map
+    // value selects the file of the table
+    if (e->has_pawns)
+    {
+        int lead = f->pairs[0][0].pieces[0] ^ flip_color;
+        Bitboard b = lead_pawns = pos.pieces[lead >> 3][PAWN];
+        while (b)
+            squares[size ++] = pop_lsb(b) ^ flip_squares;
+        lead_count = size;
+
+        std::swap(squares[0], *std::max_element(squares, squares + lead_count, pawns_less));
+        file = std::min(square_x(squares[0]), 7 - square_x(squares[0]));
+    }
+
+    const PairsData& d = f->pairs[f->sides == 2 ? stm : 0][file];
+
+    if (dtz && (d.flags & PAIRS_STM) != stm && !(e->key == e->key2 && !e->has_pawns))
+    {
+        state = PROBE_CHANGE_STM;
+        return 0;
+    }
+
+    for (int c = 0; c < 2; c ++)
+    {
+        for (int t = 0; t < 6; t ++)
+        {
+            Bitboard b = pos.pieces[c][t] & ~lead_pawns;
+            while (b)
+            {
+                squares[size] = pop_lsb(b) ^ flip_squares;
+                pieces[size ++] = ((c << 3) | (t + 1)) ^ flip_color;
+            }
+        }
+    }
+
+    // Same piece order as the table
+    for (int i = lead_count; i < size - 1; i ++)
+    {
+        for (int j = i + 1; j < size; j ++)
+        {
+            if (d.pieces[i] == pieces[j])
+            {
+                std::swap(pieces[i], pieces[j]);
+                std::swap(squares[i], squares[j]);
+                break;
+            }
+        }
+    }
+
+    // Mirror the leading piece into files a-d
+    if (square_x(squares[0]) > 3)
+    {
+        for (int i = 0; i < size; i ++)
+            squares[i] ^= 7;
+    }
+
+    uint64_t idx;
+    if (e->has_pawns)
+    {
+        idx = INDEX.lead_pawn_idx[lead_count][squares[0]];
+        std::stable_sort(squares + 1, squares + lead_count, pawns_less);
+        for (int i = 1; i < lead_count; i ++)
+            idx += INDEX.binomial[i][INDEX.map_pawns[squares[i]]];
+    }
+    else
+    {
+        // Without pawns the leading piece goes into the a1-d1-d4 triangle,
+        // the first piece off the diagonal below it
+        if (square_y(squares[0]) > 3)
+        {
+            for (int i = 0; i < size; i ++)
+                squares[i] ^= 56;
+        }
+
+        for (int i = 0; i < d.group_len[0]; i ++)
+        {
+            if (!off_diagonal(squares[i]))
+                continue;
+
+            if (off_diagonal(squares[i]) > 0)
+            {
+                for (int j = i; j < size; j ++)
+                    squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+            }
+            break;
+        }
+
+        if (e->has_unique_pieces)
+        {
+            int adjust1 = squares[1] > squares[0];
+            int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+
+            if (off_diagonal(squares[0]))
+                idx = (INDEX.map_a1d1d4[squares[0]] * 63 + (squares[1] - adjust1)) * 62
+                    + squares[2] - adjust2;
+            else if (off_diagonal(squares[1]))
+                idx = (6 * 63 + square_y(squares[0]) * 28 + INDEX.map_b1h1h7[squares[1]]) * 62
+                    + squares[2] - adjust2;
+            else if (off_diagonal(squares[2]))
+                idx = 6 * 63 * 62 + 4 * 28 * 62
+                    + square_y(squares[0]) * 7 * 28
+                    + (square_y(squares[1]) - adjust1) * 28
+                    + INDEX.map_b1h1h7[squares[2]];
+            else
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28
+                    + square_y(squares[0]) * 7 * 6
+                    + (square_y(squares[1]) - adjust1) * 6
+                    + (square_y(squares[2]) - adjust2);
+        }
+        else
+            idx = INDEX.kk_idx[INDEX.map_a1d1d4[squares[0]]][squares[1]];
+    }
+
+    // The other groups choose their squares among the ones still free
+    idx *= d.group_idx[0];
+    int* group = squares + d.group_len[0];
+    bool remaining_pawns = e->has_pawns && e->pawn_count[1];
+
+    for (int next = 1; d.group_len[next]; next ++)
+    {
+        std::stable_sort(group, group + d.group_len[next]);
+
+        uint64_t n = 0;
+        for (int i = 0; i < d.group_len[next]; i ++)
+        {
+            int adjust = std::count_if(squares, group, [&](int sq) { return group[i] > sq; });
+            n += INDEX.binomial[i + 1][group[i] - adjust - 8 * remaining_pawns];
+        }
+
+        remaining_pawns = false;
+        idx += n * d.group_idx[next];
+        group += d.group_len[next];
+    }
+
+    int value = decompress_pairs(d, idx);
+    return dtz ? map_dtz(*f, d, value, wdl) : value - 2;
+}
+
+static bool is_zeroing(const Position& pos, const Move& m)
+{
+    return m.is_capture() || (pos.pieces[pos.side][PAWN] & square_bb(m.from()));
+}
+
+// The tables hold "don't care" values where a capture (or, for DTZ, a pawn
+// move) is best, so those moves are searched and their best result kept
+int Tablebases::search_captures(const Position& pos, bool pawn_moves, ProbeState& state)
+{
+    MoveList moves;
+    pos.get_legal_moves(moves);
+
+    int best = WDL_LOSS;
+    int move_count = 0;
+    for (auto& m : moves)
+    {
+        if (!m.is_capture() && (!pawn_moves || !is_zeroing(pos, m)))
+            continue;
+
+        move_count ++;
+        Position next = pos;
+        next.make_move(m);
+        int value = -search_captures(next, false, state);
+        if (state == PROBE_FAIL)
+            return WDL_DRAW;
+
+        if (value > best)
+        {
+            best = value;
+            if (value >= WDL_WIN)
+            {
+                state = PROBE_ZEROING;
+                return value;
+            }
+        }
+    }
+
+    // All legal moves searched: the stored value may be wrong, e.g. for en passant
+    bool no_more_moves = move_count && move_count == moves.size();
+
+    int value = best;
+    if (!no_more_moves)
+    {
+        value = probe_table(pos, false, 0, state);
+        if (state == PROBE_FAIL)
+            return WDL_DRAW;
+    }
+
+    if (best >= value)
+    {
+        state = (best > WDL_DRAW || no_more_moves) ? PROBE_ZEROING : PROBE_OK;
+        return best;
+    }
+
+    state = PROBE_OK;
+    return value;
+}
+
+// DTZ of the move before a zeroing move with result `wdl`
+static int dtz_before_zeroing(int wdl)
+{
+    return wdl == WDL_WIN          ?  1   :
+           wdl == WDL_CURSED_WIN   ?  101 :
+           wdl == WDL_BLESSED_LOSS ? -101 :
+           wdl == WDL_LOSS         ? -1   : 0;
+}
+
+static int sign_of(int v)
+{
+    return (v > 0) - (v < 0);
+}
+
+static bool is_mate(const Position& pos)
+{
+    MoveList moves;
+    pos.get_legal_moves(moves);
+    return moves.empty() && pos.in_check();
+}
+
+int Tablebases::search_dtz(const Position& pos, ProbeState& state)
+{
+    state = PROBE_OK;
+    int wdl = search_captures(pos, true, state);
+
+    // Draws are not stored
+    if (state == PROBE_FAIL || wdl == WDL_DRAW)
+        return 0;
+
+    if (state == PROBE_ZEROING)
+        return dtz_before_zeroing(wdl);
+
+    int dtz = probe_table(pos, true, wdl, state);
+    if (state == PROBE_FAIL)
+        return 0;
+
+    if (state != PROBE_CHANGE_STM)
+        return (dtz + 100 * (wdl == WDL_BLESSED_LOSS || wdl == WDL_CURSED_WIN)) * sign_of(wdl);
+
+    // Only the other side to move is stored: one ply of search, keep the
+    // quickest move that holds the result
+    MoveList moves;
+    pos.get_legal_moves(moves);
+
+    int min_dtz = 0xFFFF;
+    for (auto& m : moves)
+    {
+        bool zeroing = is_zeroing(pos, m);
+        Position next = pos;
+        next.make_move(m);
+
+        // A zeroing move takes the DTZ before it, the result after it gives the sign
+        dtz = zeroing ? -dtz_before_zeroing(search_captures(next, false, state))
+                      : -search_dtz(next, state);
+        if (state == PROBE_FAIL)
+            return 0;
+
+        if (dtz == 1 && is_mate(next))
+            min_dtz = 1;
+
+        if (!zeroing)
+            dtz += sign_of(dtz);
+
+        if (dtz < min_dtz && sign_of(dtz) == sign_of(wdl))
+            min_dtz = dtz;
+    }
+
+    // No legal moves: mated
+    return min_dtz == 0xFFFF ? -1 : min_dtz;
+}
+
+bool Tablebases::probe_wdl(const Position& pos, int& wdl)
+{
+    ProbeState state = PROBE_OK;
+    wdl = search_captures(pos, false, state);
+    return state != PROBE_FAIL;
+}
+
+bool Tablebases::probe_dtz(const Position& pos, int& dtz)
+{
+    ProbeState state = PROBE_OK;
+    dtz = search_dtz(pos, state);
+    return state != PROBE_FAIL;
+}
+
+bool Tablebases::filter_root_moves(const Position& pos, MoveList& moves)
+{
+    if (moves.empty() || pos.castling || popcount(pos.occupied) > max_pieces)
+        return false;
+
+    // Wins rank by the fewest plies to the next zeroing move, which keeps
+    // the engine from shuffling in a won ending; losses by the most
+    int ranks[MAX_MOVES];
+    int best = -TB_MAX_DTZ - 1;
+
+    for (int i = 0; i < moves.size(); i ++)
+    {
+        Position next = pos;
+        next.make_move(moves[i]);
+
+        ProbeState state = PROBE_OK;
+        int dtz;
+        if (is_zeroing(pos, moves[i]))
+            dtz = dtz_before_zeroing(-search_captures(next, false, state));
+        else
+        {
+            dtz = -search_dtz(next, state);
+            dtz += sign_of(dtz);
+        }
+        if (state == PROBE_FAIL)
+            return false;
+
+        if (dtz == 2 && is_mate(next))
+            dtz = 1;
+
+        ranks[i] = dtz > 0 ? TB_MAX_DTZ - dtz
+                 : dtz < 0 ? -TB_MAX_DTZ - dtz
+                 : 0;
+        best = std::max(best, ranks[i]);
+    }
+
+    MoveList kept;
+    for (int i = 0; i < moves.size(); i ++)
+    {
+        if (ranks[i] == best)
+            kept.push_back(moves[i]);
+    }
+    moves = kept;
+    return true;
+}
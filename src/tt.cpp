@@ -0,0 +1,150 @@
+#include "tt.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Data word layout:
+//  bits  0-31 score
+//  bits 32-47 best move
+//  bits 48-55 depth + 1 (0 marks an empty slot)
+//  bits 56-57 bound
+//  bits 58-63 generation
+static inline uint64_t pack(int score, Move move, int depth, Bound bound, uint8_t generation)
+{
+    return uint64_t(uint32_t(score)) |
+           (uint64_t(move.data) << 32) |
+           (uint64_t(uint8_t(depth + 1)) << 48) |
+           (uint64_t(bound) << 56) |
+           (uint64_t(generation & 0x3F) << 58);
+}
+
+static inline int data_depth(uint64_t data)
+{
+    return int((data >> 48) & 0xFF) - 1;
+}
+
+static inline uint8_t data_generation(uint64_t data)
+{
+    return uint8_t(data >> 58);
+}
+
+TranspositionTable::TranspositionTable(size_t mb)
+{
+    resize(mb);
+}
+
+TranspositionTable::~TranspositionTable()
+{
+    delete[] table;
+}
+
+void TranspositionTable::resize(size_t mb)
+{
+    delete[] table;
+
+    cluster_count = std::max<size_t>(1, mb * 1024 * 1024 / sizeof(Cluster));
+    table = new Cluster[cluster_count];
+    clear();
+}
+
+void TranspositionTable::clear()
+{
+    for (size_t i = 0; i < cluster_count; i ++)
+    {
+        for (auto& slot : table[i].slots)
+        {
+            slot.key.store(0, std::memory_order_relaxed);
+            slot.data.store(0, std::memory_order_relaxed);
+        }
+    }
+    generation = 0;
+}
+
+void TranspositionTable::new_search()
+{
+    generation = (generation + 1) & 0x3F;
+}
+
+TranspositionTable::Cluster& TranspositionTable::cluster(uint64_t key) const
+{
+    // Map the key onto [0, cluster_count) without a modulo
+    return table[(unsigned __int128)key * cluster_count >> 64];
+}
+
+bool TranspositionTable::probe(uint64_t key, TTEntry& entry) const
+{
+    for (auto& slot : cluster(key).slots)
+    {
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        if ((slot.key.load(std::memory_order_relaxed) ^ data) != key || !data)
+            continue;
+
+        entry.score = int32_t(uint32_t(data));
+        entry.move.data = uint16_t(data >> 32);
+        entry.depth = data_depth(data);
+        entry.bound = Bound((data >> 56) & 0x3);
+        return true;
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, Bound bound, int score, const Move* best)
+{
+    Cluster& c = cluster(key);
+    Slot* replace = &c.slots[0];
+    int replace_value = 1 << 30;
+
+    for (auto& slot : c.slots)
+    {
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+
+        // Same position (or an empty slot): always overwrite
+        if (!data || (slot.key.load(std::memory_order_relaxed) ^ data) == key)
+        {
+            replace = &slot;
+
+            // Keep the old best move when this result has none
+            if (data && !best)
+            {
+                Move old;
+                old.data = uint16_t(data >> 32);
+                uint64_t packed = pack(score, old, depth, bound, generation);
+                slot.key.store(key ^ packed, std::memory_order_relaxed);
+                slot.data.store(packed, std::memory_order_relaxed);
+                return;
+            }
+            break;
+        }
+
+        // Otherwise evict the shallowest entry, preferring ones from older searches
+        int age = (generation - data_generation(data)) & 0x3F;
+        int value = data_depth(data) - 8 * age;
+        if (value < replace_value)
+        {
+            replace_value = value;
+            replace = &slot;
+        }
+    }
+
+    uint64_t packed = pack(score, best ? *best : Move{}, depth, bound, generation);
+
+    replace->key.store(key ^ packed, std::memory_order_relaxed);
+    replace->data.store(packed, std::memory_order_relaxed);
+}
+
+int TranspositionTable::hashfull() const
+{
+    size_t sample = std::min<size_t>(cluster_count, 1000);
+    int used = 0;
+
+    for (size_t i = 0; i < sample; i ++)
+    {
+        for (auto& slot : table[i].slots)
+        {
+            uint64_t data = slot.data.load(std::memory_order_relaxed);
+            if (data && data_generation(data) == generation)
+                used ++;
+        }
+    }
+    return int(used * 1000 / (sample * CLUSTER_SIZE));
+}
@@ -0,0 +1,437 @@
+#include "bench.hpp"
+#include "book.hpp"
+#include "chess.hpp"
+#include "engine.hpp"
+#include "perft.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+static const char* START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+static const int DEFAULT_HASH_MB = 16;
+static const int MAX_HASH_MB     = 65536;
+static const int MAX_THREADS     = 256;
+static const int BENCH_DEPTH     = 5;
+
+class UciFrontend
+{
+private:
+    ChessBoard board;
+    ChessEngine engine;
+    OpeningBook book;
+    bool own_book = false;
+
+    std::thread worker;
+    std::atomic<bool> stop_requested = false;
+    std::mutex output_lock;
+
+    // Wakes a finished infinite or ponder search on stop or ponderhit
+    std::mutex wait_lock;
+    std::condition_variable wake;
+
+    void send(const std::string& line);
+    void send_info(const SearchInfo& info);
+
+    void cmd_uci();
+    void cmd_setoption(std::istringstream& in);
+    void cmd_position(std::istringstream& in);
+    void cmd_go(std::istringstream& in);
+    void cmd_stop();
+    void cmd_ponderhit();
+    void notify_worker();
+    void cmd_perft(std::istringstream& in);
+    void cmd_bench(std::istringstream& in);
+
+public:
+    UciFrontend();
+    ~UciFrontend();
+
+    bool failed = false; // set when a self check such as the perft suite fails
+
+    bool execute(const std::string& line);
+    void loop();
+};
+
+UciFrontend::UciFrontend()
+{
+    // Without a network the hand-written evaluation is used
+    nnue_load(NNUE_DEFAULT_FILE);
+    board.load_fen(START_FEN);
+    engine.set_hash_size(DEFAULT_HASH_MB);
+    engine.set_info_callback([this](const SearchInfo& info) { send_info(info); });
+}
+
+UciFrontend::~UciFrontend()
+{
+    cmd_stop();
+}
+
+void UciFrontend::send(const std::string& line)
+{
+    std::lock_guard<std::mutex> guard(output_lock);
+    std::cout << line << std::endl;
+}
+
+void UciFrontend::send_info(const SearchInfo& info)
+{
+    std::ostringstream out;
+    out << "info depth " << info.depth << " score ";
+
+    if (std::abs(info.score) >= MATE_IN_MAX)
+    {
+        // Plies to mate, reported in moves
+        int plies = MATE_SCORE - std::abs(info.score);
+        out << "mate " << (info.score > 0 ? (plies + 1) / 2 : -(plies / 2));
+    }
+    else
+        out << "cp " << info.score;
+
+    uint64_t nps = info.time ? info.nodes * 1000 / info.time : 0;
+    out << " nodes " << info.nodes << " nps " << nps << " hashfull " << info.hashfull
+        << " tbhits " << info.tbhits
+        << " time " << info.time << " pv";
+
+    for (auto& m : info.pv)
+        out << " " << move_to_string(m);
+
+    send(out.str());
+}
+
+void UciFrontend::cmd_uci()
+{
+    send("id name Chess2");
+    send("id author f3fe-hash");
+    send("option name Hash type spin default " + std::to_string(DEFAULT_HASH_MB) +
+         " min 1 max " + std::to_string(MAX_HASH_MB));
+    send("option name Threads type spin default 1 min 1 max " + std::to_string(MAX_THREADS));
+    send("option name Ponder type check default false");
+    send("option name OwnBook type check default false");
+    send("option name BookFile type string default <empty>");
+    send("option name BookDepth type spin default " + std::to_string(DEFAULT_BOOK_DEPTH) + " min 0 max 200");
+    send("option name SyzygyPath type string default <empty>");
+    send(std::string("option name EvalFile type string default ") + NNUE_DEFAULT_FILE);
+    send("uciok");
+}
+
+void UciFrontend::cmd_setoption(std::istringstream& in)
+{
+    // setoption name <id> [value <x>], the name and value may contain spaces
+    std::string token, name, value;
+    in >> token;
+    while (in >> token && token != "value")
+        name += (name.empty() ? "" : " ") + token;
+    std::getline(in >> std::ws, value);
+
+    try
+    {
+        if (name == "Hash")
+            engine.set_hash_size(std::clamp(std::stoi(value), 1, MAX_HASH_MB));
+        else if (name == "Threads")
+            engine.set_threads(std::clamp(std::stoi(value), 1, MAX_THREADS));
+        else if (name == "Ponder")
+            ; // pondering is driven by "go ponder", nothing to configure
+        else if (name == "OwnBook")
+            own_book = value == "true";
+        else if (name == "BookFile")
+        {
+            if (value.empty() || value == "<empty>")
+                book.close();
+            else if (!book.open(value))
+                send("info string cannot open book " + value);
+        }
+        else if (name == "BookDepth")
+            book.set_depth(std::clamp(std::stoi(value), 0, 200));
+        else if (name == "EvalFile")
+        {
+            if (value.empty() || value == "<empty>")
+                nnue_unload();
+            else if (!nnue_load(value))
+                send("info string cannot load network " + value);
+            board.refresh_accumulator();
+        }
+        else if (name == "SyzygyPath")
+        {
+            int found = engine.set_syzygy_path(value);
+            if (found)
+                send("info string found " + std::to_string(found) + " tablebases");
+        }
+        else
+            send("info string unknown option " + name);
+    }
+    catch (const std::exception&)
+    {
+        send("info string invalid value for " + name);
+    }
+}
+
+void UciFrontend::cmd_position(std::istringstream& in)
+{
+    std::string token, fen;
+    in >> token;
+
+    if (token == "startpos")
+    {
+        fen = START_FEN;
+        in >> token; // "moves", if any
+    }
+    else if (token == "fen")
+    {
+        while (in >> token && token != "moves")
+            fen += token + " ";
+    }
+    else
+        return;
+
+    // A bad FEN leaves the previous position in place
+    ChessBoard loaded;
+    try
+    {
+        loaded.load_fen(fen);
+    }
+    catch (const std::exception& e)
+    {
+        send(std::string("info string invalid fen: ") + e.what());
+        return;
+    }
+    board = loaded;
+
+    while (in >> token)
+    {
+        // The undo stack keeps MAX_PLY entries free for the search
+        if (board.game_ply() >= MAX_GAME_PLY)
+        {
+            send("info string game too long, ignoring moves from " + token);
+            return;
+        }
+
+        Move m;
+        if (!board.parse_move(token, m))
+        {
+            send("info string illegal move " + token);
+            return;
+        }
+        board.make_move(&m);
+    }
+}
+
+void UciFrontend::cmd_go(std::istringstream& in)
+{
+    SearchLimits limits;
+    std::string token;
+
+    while (in >> token)
+    {
+        if (token == "depth")          in >> limits.depth;
+        else if (token == "movetime")  in >> limits.movetime;
+        else if (token == "nodes")     in >> limits.nodes;
+        else if (token == "wtime")     in >> limits.wtime;
+        else if (token == "btime")     in >> limits.btime;
+        else if (token == "winc")      in >> limits.winc;
+        else if (token == "binc")      in >> limits.binc;
+        else if (token == "movestogo") in >> limits.movestogo;
+        else if (token == "infinite")  limits.infinite = true;
+        else if (token == "ponder")    limits.ponder = true;
+    }
+
+    cmd_stop();
+
+    // A book move is played at once, except when the GUI asked for analysis
+    Move book_move;
+    if (own_book && !limits.infinite && !limits.ponder && book.probe(board, book_move))
+    {
+        send("bestmove " + move_to_string(book_move));
+        return;
+    }
+
+    stop_requested = false;
+    engine.start_clock(limits, board.turn);
+    worker = std::thread([this, limits, position = board]()
+    {
+        Move best = engine.think(&position, limits);
+
+        // Infinite and ponder searches only report once the GUI asks for it
+        {
+            std::unique_lock<std::mutex> lock(wait_lock);
+            wake.wait(lock, [&]
+            {
+                return stop_requested || !(limits.infinite || engine.is_pondering());
+            });
+        }
+
+        MoveList legal;
+        ChessBoard(position).get_legal_moves(legal);
+        if (legal.empty())
+        {
+            send("bestmove 0000");
+            return;
+        }
+
+        // The expected reply is what the engine ponders on next
+        std::vector<Move> pv;
+        engine.get_pv(&position, 2, pv);
+
+        std::string line = "bestmove " + move_to_string(best);
+        if (pv.size() == 2 && pv[0] == best)
+            line += " ponder " + move_to_string(pv[1]);
+        send(line);
+    });
+}
+
+void UciFrontend::notify_worker()
+{
+    // Taking the lock orders the change before the worker's next check of it
+    {
+        std::lock_guard<std::mutex> guard(wait_lock);
+    }
+    wake.notify_all();
+}
+
+void UciFrontend::cmd_stop()
+{
+    stop_requested = true;
+    engine.stop();
+    notify_worker();
+
+    if (worker.joinable())
+        worker.join();
+}
+
+void UciFrontend::cmd_ponderhit()
+{
+    engine.ponderhit();
+    notify_worker();
+}
+
+void UciFrontend::cmd_perft(std::istringstream& in)
+{
+    // perft <depth> [threads] divides the current position,
+    // perft suite [threads] checks the reference positions,
+    // perft compare [extra depth] times make/unmake against copy-make
+    std::string arg;
+    in >> arg;
+
+    std::lock_guard<std::mutex> guard(output_lock);
+    if (arg == "compare")
+    {
+        int extra_depth = 0;
+        in >> extra_depth;
+        failed |= !perft_compare(extra_depth, std::cout);
+        return;
+    }
+
+    int threads = 1;
+    in >> threads;
+    if (arg == "suite")
+    {
+        failed |= !perft_suite(threads, std::cout);
+        return;
+    }
+
+    try
+    {
+        perft_divide(board, std::stoi(arg), threads, std::cout);
+    }
+    catch (const std::exception&)
+    {
+        std::cout << "info string usage: perft <depth>|suite [threads], perft compare [extra depth]" << std::endl;
+    }
+}
+
+void UciFrontend::cmd_bench(std::istringstream& in)
+{
+    int depth = BENCH_DEPTH;
+    in >> depth;
+
+    std::lock_guard<std::mutex> guard(output_lock);
+    bench(std::max(1, depth), std::cout);
+}
+
+// Returns false once the front end should exit
+bool UciFrontend::execute(const std::string& line)
+{
+    std::istringstream in(line);
+    std::string cmd;
+    in >> cmd;
+
+    if (cmd == "uci")
+        cmd_uci();
+    else if (cmd == "isready")
+        send("readyok");
+    else if (cmd == "ucinewgame")
+    {
+        cmd_stop();
+        engine.clear_hash();
+    }
+    else if (cmd == "setoption")
+    {
+        cmd_stop();
+        cmd_setoption(in);
+    }
+    else if (cmd == "position")
+    {
+        cmd_stop();
+        cmd_position(in);
+    }
+    else if (cmd == "go")
+        cmd_go(in);
+    else if (cmd == "stop")
+        cmd_stop();
+    else if (cmd == "ponderhit")
+        cmd_ponderhit();
+    else if (cmd == "quit")
+        return false;
+    else if (cmd == "d")
+        board.print();
+    else if (cmd == "eval")
+        send("info string static eval " + std::to_string(engine.eval(&board)) + " cp (white's view, " +
+             (NNUE_NET ? "network" : "hand-written") + ")");
+    else if (cmd == "perft")
+    {
+        cmd_stop();
+        cmd_perft(in);
+    }
+    else if (cmd == "bench")
+    {
+        cmd_stop();
+        cmd_bench(in);
+    }
+    else if (!cmd.empty())
+        send("info string unknown command " + cmd);
+
+    return true;
+}
+
+void UciFrontend::loop()
+{
+    std::string line;
+    while (std::getline(std::cin, line) && execute(line))
+        ;
+}
+
+int main(int argc, char** argv)
+{
+    std::ios::sync_with_stdio(false);
+
+    UciFrontend uci;
+
+    // Arguments run as a single command, e.g. `Chess2-uci perft suite 4`
+    if (argc > 1)
+    {
+        std::string line;
+        for (int i = 1; i < argc; i ++)
+            line += std::string(argv[i]) + " ";
+        uci.execute(line);
+        return uci.failed ? 1 : 0;
+    }
+
+    uci.loop();
+    return 0;
+}